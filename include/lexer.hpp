@@ -51,17 +51,50 @@ using tr1::shared_ptr;
 #endif
 #endif
 
+#include <algorithm>
 #include <cctype>
 #include <cerrno>
 #include <climits>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
+#include <iterator>
 #include <map>
 #include <sstream>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
+// worker threads for batched lexing need C++11 <thread>; define
+// LEXER_NO_THREADS to force single-threaded batches.
+#if !defined(LEXER_NO_THREADS) &&                                              \
+    (__cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1700))
+#define LEXER_HAS_THREADS
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#endif
+
+// memory-mapped files (token cache) use POSIX mmap; other platforms, or
+// builds defining LEXER_NO_MMAP, read the file into memory instead.
+#if defined(_WIN32) && !defined(LEXER_NO_MMAP)
+#define LEXER_NO_MMAP
+#endif
+#if !defined(LEXER_NO_MMAP)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+// process ids make token cache temp files unique across writers
+#if defined(_WIN32)
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
 namespace lexer {
 /**
  * represents a location within a piece of input or source.
@@ -98,32 +131,46 @@ inline std::ostream &operator<<(std::ostream &os, const Location &loc) {
  */
 class InputIter {
 public:
+  // snapshot of the iterator's position, used for lexer checkpoints.
+  // plain values only, so saving/restoring never allocates.
+  struct State {
+    size_t pos;
+    size_t line;
+    size_t col;
+  };
+
   InputIter(const std::string &filename, const std::vector<char> &code)
-      : m_input(code), m_filename(filename), m_line(1), m_col(1), m_pos(0) {}
+      : m_input(code.empty() ? nullptr : &code[0]), m_size(code.size()),
+        m_filename(filename), m_line(1), m_col(1), m_pos(0) {}
+
+  // iterate over a raw window of memory (must outlive the iterator)
+  InputIter(const std::string &filename, const char *data, size_t size)
+      : m_input(data), m_size(size), m_filename(filename), m_line(1),
+        m_col(1), m_pos(0) {}
 
   char current() const {
-    if (m_pos < m_input.size()) {
+    if (m_pos < m_size) {
       return m_input[m_pos];
     }
     return '\0';
   }
 
   char peek() const {
-    if (m_pos + 1 < m_input.size()) {
+    if (m_pos + 1 < m_size) {
       return m_input[m_pos + 1];
     }
     return '\0';
   }
 
   char peek2() const {
-    if (m_pos + 2 < m_input.size()) {
+    if (m_pos + 2 < m_size) {
       return m_input[m_pos + 2];
     }
     return '\0';
   }
 
   void next() {
-    if (m_pos < m_input.size()) {
+    if (m_pos < m_size) {
       if (m_input[m_pos] == '\n') {
         m_line++;
         m_col = 1;
@@ -141,15 +188,30 @@ public:
     next();
   }
 
-  bool has_more() const { return m_pos < m_input.size(); }
+  bool has_more() const { return m_pos < m_size; }
   size_t position() const { return m_pos; }
   Location get_location() const { return Location(m_filename, m_line, m_col); }
   size_t get_line() const { return m_line; }
   size_t get_col() const { return m_col; }
   const std::string &get_filename() const { return m_filename; }
 
+  State save() const {
+    State state;
+    state.pos = m_pos;
+    state.line = m_line;
+    state.col = m_col;
+    return state;
+  }
+
+  void restore(const State &state) {
+    m_pos = state.pos;
+    m_line = state.line;
+    m_col = state.col;
+  }
+
 private:
-  const std::vector<char> &m_input;
+  const char *m_input;
+  size_t m_size;
   std::string m_filename;
   size_t m_line;
   size_t m_col;
@@ -173,7 +235,9 @@ public:
     file.seekg(0, std::ios::end);
     std::streampos size = file.tellg();
     if (size < 0) {
-      throw std::runtime_error("error determining size of file: " + filename);
+      // not seekable (pipe, fifo, character device): read it sequentially
+      file.clear();
+      return from_stream(file, filename);
     }
     std::vector<char> buffer(static_cast<size_t>(size));
     file.seekg(0, std::ios::beg);
@@ -188,6 +252,21 @@ public:
     return Src(filename, buffer);
   }
 
+  // reads a stream to its end (works for pipes and other unseekable input).
+  // see StreamLexer for lexing unbounded input in bounded memory.
+  static Src from_stream(std::istream &in,
+                         const std::string &filename = "<stdin>") {
+    std::vector<char> buffer;
+    char chunk[4096];
+    while (in.read(chunk, sizeof(chunk)) || in.gcount() > 0) {
+      buffer.insert(buffer.end(), chunk, chunk + in.gcount());
+    }
+    if (in.bad()) {
+      throw std::runtime_error("error reading stream: " + filename);
+    }
+    return Src(filename, buffer);
+  }
+
   static Src from_string(const std::string &code_str,
                          const std::string &filename = "<string>") {
     std::vector<char> chars(code_str.begin(), code_str.end());
@@ -350,9 +429,24 @@ enum TokenKind {
   TokFloatLit,
   TokStrLit,
   TokFlagShort, // e.g., -f
-  TokFlagLong   // e.g., --force
+  TokFlagLong,  // e.g., --force
+
+  // opt-in operators, appended so existing kinds keep their values
+  TokFatArrow,    // =>, not in the default operator table
+  TokDoubleColon, // ::, not in the default operator table
+  TokDotDot       // .., not in the default operator table
 };
 
+// bit set of token kinds, used to filter lexer output.
+// note: every TokenKind must stay below 64 for the mask to cover it.
+typedef unsigned long long KindMask;
+
+inline KindMask kind_bit(TokenKind kind) {
+  return static_cast<KindMask>(1) << static_cast<unsigned>(kind);
+}
+
+const KindMask all_token_kinds = ~static_cast<KindMask>(0);
+
 struct Span {
   size_t start;
   size_t end;
@@ -474,6 +568,7 @@ public:
 
   TokenKind get_kind() const { return m_kind; }
   const Span &get_span() const { return m_span; }
+  void set_span(const Span &span) { m_span = span; }
 
   // getter methods for complex token data below
 
@@ -638,6 +733,9 @@ public:
       simple_tokens[TokGreaterEq] = ">=";
       simple_tokens[TokEq] = "==";
       simple_tokens[TokNotEq] = "!=";
+      simple_tokens[TokFatArrow] = "=>";
+      simple_tokens[TokDoubleColon] = "::";
+      simple_tokens[TokDotDot] = "..";
       simple_tokens[TokLParen] = "(";
       simple_tokens[TokRParen] = ")";
       simple_tokens[TokLBrace] = "{";
@@ -838,9 +936,128 @@ inline std::ostream &operator<<(std::ostream &os, const Token &token) {
   return os;
 }
 
+/**
+ * maximal-munch table for operator and punctuation tokens of up to two
+ * characters. the first byte indexes a row holding the single-character
+ * kind (if any) and a short list of two-character continuations, so
+ * matching an operator costs one row load and a scan of that row only.
+ * dialects can copy the defaults and add operators such as "=>" or "::".
+ */
+class OperatorTable {
+public:
+  // max number of two-character operators sharing the same first byte
+  static const size_t max_pairs = 4;
+
+  OperatorTable() {
+    for (size_t i = 0; i < 256; ++i) {
+      m_rows[i].has_single = false;
+      m_rows[i].single = TokEof;
+      m_rows[i].num_pairs = 0;
+    }
+  }
+
+  // table with the operators/punctuation of the default language
+  static const OperatorTable &defaults() {
+    static OperatorTable table = make_defaults();
+    return table;
+  }
+
+  /**
+   * adds (or replaces) a one- or two-character operator.
+   * note: '-' and '/' are still checked for flags and path-like
+   * identifiers before the table is consulted.
+   */
+  OperatorTable &add(const char *op, TokenKind kind) {
+    size_t len = op ? std::strlen(op) : 0;
+    if (len < 1 || len > 2) {
+      throw std::invalid_argument("operator must be one or two characters");
+    }
+    Row &row = m_rows[static_cast<unsigned char>(op[0])];
+    if (len == 1) {
+      row.has_single = true;
+      row.single = kind;
+      return *this;
+    }
+    for (size_t i = 0; i < row.num_pairs; ++i) {
+      if (row.second[i] == op[1]) {
+        row.pair_kind[i] = kind;
+        return *this;
+      }
+    }
+    if (row.num_pairs == max_pairs) {
+      throw std::length_error(std::string("too many operators starting with '") +
+                              op[0] + "'");
+    }
+    row.second[row.num_pairs] = op[1];
+    row.pair_kind[row.num_pairs] = kind;
+    row.num_pairs++;
+    return *this;
+  }
+
+  /**
+   * matches the longest operator starting with c0 (followed by c1).
+   * on success, sets kind and len (1 or 2) and returns true.
+   */
+  bool match(char c0, char c1, TokenKind &kind, size_t &len) const {
+    const Row &row = m_rows[static_cast<unsigned char>(c0)];
+    for (size_t i = 0; i < row.num_pairs; ++i) {
+      if (row.second[i] == c1) {
+        kind = row.pair_kind[i];
+        len = 2;
+        return true;
+      }
+    }
+    if (row.has_single) {
+      kind = row.single;
+      len = 1;
+      return true;
+    }
+    return false;
+  }
+
+private:
+  struct Row {
+    bool has_single;
+    TokenKind single;
+    size_t num_pairs;
+    char second[max_pairs];
+    TokenKind pair_kind[max_pairs];
+  };
+
+  static OperatorTable make_defaults() {
+    OperatorTable table;
+    table.add("+", TokPlus).add("*", TokTimes).add("%", TokModulo);
+    table.add("/", TokDivide);
+    table.add("(", TokLParen).add(")", TokRParen);
+    table.add("{", TokLBrace).add("}", TokRBrace);
+    table.add("[", TokLBracket).add("]", TokRBracket);
+    table.add(";", TokSemi).add(":", TokColon).add(",", TokComma);
+    table.add(".", TokDot);
+    table.add("-", TokMinus).add("--", TokDoubleMinus);
+    table.add("<", TokLess).add("<<", TokShl).add("<=", TokLessEq);
+    table.add(">", TokGreater).add(">>", TokShr).add(">=", TokGreaterEq);
+    table.add("=", TokAssign).add("==", TokEq);
+    table.add("!", TokNot).add("!=", TokNotEq);
+    return table;
+  }
+
+  Row m_rows[256];
+};
+
 // facility for tokenizing source code or input strings
 class Lexer {
 public:
+  /**
+   * saved lexer state for speculative parsing.
+   * captures the input position and the number of tokens produced so far;
+   * rewinding to it drops any tokens lexed after the checkpoint was taken.
+   */
+  struct Checkpoint {
+    InputIter::State iter_state;
+    size_t token_count;
+    bool done;
+  };
+
   /**
    * primary static function to tokenize source (input, code, etc.).
    * takes a source object and returns a vector of tokens.
@@ -852,16 +1069,119 @@ public:
     return lexer.m_tokens;
   }
 
-private:
-  // private constructor - only used internally by the static tokenize method
-  Lexer(const Src &source)
-      : m_iter(source.get_iterator()), m_input_ptr(source.get_code_ptr()) {
+  // tokenize using a dialect-specific operator table
+  static std::vector<Token> tokenize(const Src &source,
+                                     const OperatorTable &operators) {
+    Lexer lexer(source);
+    lexer.set_operator_table(operators);
+    lexer.lex_all();
+    return lexer.m_tokens;
+  }
+
+  // tokenize keeping only the token kinds set in keep_kinds
+  static std::vector<Token> tokenize(const Src &source, KindMask keep_kinds) {
+    Lexer lexer(source);
+    lexer.set_kind_filter(keep_kinds);
+    lexer.lex_all();
+    return lexer.m_tokens;
+  }
+
+  /**
+   * creates a lexer for token-at-a-time use (see lex_next).
+   * note: source object must outlive the lexer and its tokens.
+   */
+  explicit Lexer(const Src &source)
+      : m_iter(source.get_iterator()), m_input_ptr(source.get_code_ptr()),
+        m_ops(&OperatorTable::defaults()), m_keep(all_token_kinds),
+        m_out(&m_tokens), m_done(false) {
     size_t estimated_tokens = source.get_code().size() / 5;
     if (estimated_tokens > 10) { // avoid tiny allocations
       m_tokens.reserve(estimated_tokens);
     }
   }
 
+  /**
+   * creates a lexer over a raw window of memory that appends its tokens to
+   * an external vector (e.g., a shared token arena).
+   * note: the memory and the output vector must outlive the lexer.
+   */
+  Lexer(const std::string &filename, const char *data, size_t size,
+        std::vector<Token> &out)
+      : m_iter(filename, data, size), m_input_ptr(data),
+        m_ops(&OperatorTable::defaults()), m_keep(all_token_kinds),
+        m_out(&out), m_done(false) {}
+
+  // use a different operator table (must outlive the lexer)
+  void set_operator_table(const OperatorTable &operators) {
+    m_ops = &operators;
+  }
+
+  /**
+   * only tokens whose kind is set in keep_kinds are appended to the output.
+   * filtered-out literals are scanned but their values are not converted.
+   * note: lexing still stops at the end of input even if TokEof is filtered.
+   */
+  void set_kind_filter(KindMask keep_kinds) { m_keep = keep_kinds; }
+  KindMask get_kind_filter() const { return m_keep; }
+
+  /**
+   * lexes the next token that passes the kind filter, appends it to the
+   * output and returns it. once the end of input is reached, TokEof is
+   * returned again without being appended a second time.
+   */
+  const Token &lex_next() {
+    while (!m_done) {
+      eat_whitespace_and_comments();
+      m_current = next_token();
+      TokenKind kind = m_current.get_kind();
+      if (kind == TokEof) {
+        m_done = true;
+      }
+      if (keeps(kind)) {
+        m_out->push_back(m_current);
+        break;
+      }
+    }
+    return m_current;
+  }
+
+  // true once TokEof has been produced
+  bool is_done() const { return m_done; }
+
+  // current offset into the input
+  size_t get_position() const { return m_iter.position(); }
+
+  // tokens produced so far (in order)
+  const std::vector<Token> &get_tokens() const { return *m_out; }
+  size_t get_token_count() const { return m_out->size(); }
+
+  // capture the current state; O(1), never allocates
+  Checkpoint checkpoint() const {
+    Checkpoint cp;
+    cp.iter_state = m_iter.save();
+    cp.token_count = m_out->size();
+    cp.done = m_done;
+    return cp;
+  }
+
+  // restore a previously captured state, truncating the token output.
+  // the output keeps its capacity, so re-lexing does not reallocate.
+  void rewind(const Checkpoint &cp) {
+    if (cp.token_count > m_out->size()) {
+      throw std::out_of_range("lexer checkpoint is ahead of the current state");
+    }
+    m_iter.restore(cp.iter_state);
+    m_out->erase(m_out->begin() + cp.token_count, m_out->end());
+    m_done = cp.done;
+  }
+
+private:
+  // private copy constructor and assignment operator to prevent copying
+  Lexer(const Lexer &);
+  Lexer &operator=(const Lexer &);
+
+  bool keeps(TokenKind kind) const { return (m_keep & kind_bit(kind)) != 0; }
+
   // helper functions for character classification
   // todo: using direct checks can be slightly faster if locale is not a
   // concern..
@@ -901,14 +1221,8 @@ private:
 
   // core lexing driver function
   void lex_all() {
-    m_tokens.clear(); // clear if lexer object was reused
-    while (true) {
-      eat_whitespace_and_comments();
-      Token token = next_token();
-      m_tokens.push_back(token);
-      if (token.get_kind() == TokEof) {
-        break;
-      }
+    while (!m_done) {
+      lex_next();
     }
   }
 
@@ -959,62 +1273,17 @@ private:
     case '\0':
       return Token(TokEof, Span(start_pos, start_pos));
 
-    // single-character tokens that are unambiguous
-    case '+':
-      next();
-      return Token(TokPlus, Span(start_pos, m_iter.position()));
-    case '*':
-      next();
-      return Token(TokTimes, Span(start_pos, m_iter.position()));
-    case '%':
-      next();
-      return Token(TokModulo, Span(start_pos, m_iter.position()));
-    case '(':
-      next();
-      return Token(TokLParen, Span(start_pos, m_iter.position()));
-    case ')':
-      next();
-      return Token(TokRParen, Span(start_pos, m_iter.position()));
-    case '{':
-      next();
-      return Token(TokLBrace, Span(start_pos, m_iter.position()));
-    case '}':
-      next();
-      return Token(TokRBrace, Span(start_pos, m_iter.position()));
-    case '[':
-      next();
-      return Token(TokLBracket, Span(start_pos, m_iter.position()));
-    case ']':
-      next();
-      return Token(TokRBracket, Span(start_pos, m_iter.position()));
-    case ';':
-      next();
-      return Token(TokSemi, Span(start_pos, m_iter.position()));
-    case ':':
-      next();
-      return Token(TokColon, Span(start_pos, m_iter.position()));
-    case ',':
-      next();
-      return Token(TokComma, Span(start_pos, m_iter.position()));
-    case '.':
-      next();
-      return Token(TokDot, Span(start_pos, m_iter.position()));
-
-    // potentially multi-character tokens
+    // flags take precedence over the '-' and '--' operators
     case '-':
-      next(); // consume '-'
-      if (current() == '-') {
-        next(); // consume second '-'
-        if (is_ident_start(current())) {
-          return lex_long_flag(start_pos);
-        } else {
-          return Token(TokDoubleMinus, Span(start_pos, m_iter.position()));
-        }
-      } else if (is_ident_start(current()) || is_ascii_dec_digit(current())) {
+      if (peek() == '-' && is_ident_start(peek2())) {
+        next2(); // consume '--'
+        return lex_long_flag(start_pos);
+      }
+      if (is_ident_start(peek()) || is_ascii_dec_digit(peek())) {
+        next(); // consume '-'
         return lex_short_flag(start_pos);
-      } else {
-        return Token(TokMinus, Span(start_pos, m_iter.position()));
       }
+      break;
 
     case '/': // division, start of comment, or start of path-like identifier
       // comments are handled by eat_whitespace_and_comments
@@ -1023,52 +1292,8 @@ private:
         // character...
         return lex_identifier_or_keyword(
             start_pos); // ...treat it as the start of an identifier
-      } else {
-        // otherwise, it's the division operator
-        next();
-        return Token(TokDivide, Span(start_pos, m_iter.position()));
-      }
-
-    case '<':
-      next();
-      if (current() == '<') {
-        next();
-        return Token(TokShl, Span(start_pos, m_iter.position()));
       }
-      if (current() == '=') {
-        next();
-        return Token(TokLessEq, Span(start_pos, m_iter.position()));
-      }
-      return Token(TokLess, Span(start_pos, m_iter.position()));
-
-    case '>':
-      next();
-      if (current() == '>') {
-        next();
-        return Token(TokShr, Span(start_pos, m_iter.position()));
-      }
-      if (current() == '=') {
-        next();
-        return Token(TokGreaterEq, Span(start_pos, m_iter.position()));
-      }
-      return Token(TokGreater, Span(start_pos, m_iter.position()));
-
-    case '=':
-      next();
-      if (current() == '=') {
-        next();
-        return Token(TokEq, Span(start_pos, m_iter.position()));
-      }
-      return Token(TokAssign, Span(start_pos, m_iter.position()));
-
-    case '!':
-      next();
-      if (current() == '=') {
-        next();
-        return Token(TokNotEq, Span(start_pos, m_iter.position()));
-      }
-      // assume '!' is TokNot if not followed by '='
-      return Token(TokNot, Span(start_pos, m_iter.position()));
+      break;
 
     // string literals
     case '"':
@@ -1087,14 +1312,27 @@ private:
     case '9':
       return lex_number(start_pos); // pass start position
 
-    // identifiers or keywords
     default:
-      if (is_ident_start(c)) {
-        return lex_identifier_or_keyword(start_pos); // pass start position
+      break;
+    }
+
+    // operators and punctuation (maximal munch via the operator table)
+    TokenKind op_kind;
+    size_t op_len;
+    if (m_ops->match(c, peek(), op_kind, op_len)) {
+      next();
+      if (op_len == 2) {
+        next();
       }
-      // unknown character
-      throw LexError::invalid_char(start_loc); // use location at start of char
+      return Token(op_kind, Span(start_pos, m_iter.position()));
+    }
+
+    // identifiers or keywords
+    if (is_ident_start(c)) {
+      return lex_identifier_or_keyword(start_pos); // pass start position
     }
+    // unknown character
+    throw LexError::invalid_char(start_loc); // use location at start of char
   }
 
   // lexes an identifier or a keyword
@@ -1331,6 +1569,11 @@ private:
     size_t end_pos = m_iter.position();
     Span number_span(start_pos, end_pos);
 
+    // filtered out: skip the conversion, the token is dropped anyway
+    if (!keeps(is_float ? TokFloatLit : TokIntLit)) {
+      return Token(is_float ? TokFloatLit : TokIntLit, number_span);
+    }
+
     if (is_float) {
       errno = 0;
       char *endptr;
@@ -1407,7 +1650,901 @@ private:
   // state
   InputIter m_iter;            // iterator over the input
   const char *m_input_ptr;     // pointer to start of the input
+  const OperatorTable *m_ops;  // operator/punctuation table
+  KindMask m_keep;             // kinds appended to the output
+  Token m_current;             // most recently lexed token
   std::vector<Token> m_tokens; // vector to store the generated tokens
+  std::vector<Token> *m_out;   // output vector (m_tokens or external arena)
+  bool m_done;                 // true once TokEof has been produced
+};
+
+/**
+ * lexes many small inputs into one contiguous token arena.
+ * all inputs are copied into a single shared source buffer, and every
+ * input's tokens (including its trailing TokEof) occupy a contiguous range
+ * of the arena. buffers keep their capacity between calls to lex(), so a
+ * reused batch does no per-line allocation once warmed up.
+ * note: spans are relative to the start of each input; string refs point
+ * into the shared buffer and stay valid until the next call to lex().
+ */
+class TokenBatch {
+public:
+  // per-input bookkeeping: where its source and tokens live
+  struct Entry {
+    size_t source_offset;
+    size_t source_length;
+    size_t token_offset;
+    size_t token_count;
+    int error_index; // index into get_errors(), or -1 if lexing succeeded
+  };
+
+  // batches with at least this many inputs are split across worker threads
+  static const size_t parallel_threshold = 1024;
+
+  TokenBatch() {}
+
+  /**
+   * lexes every input string. inputs that fail to lex get an empty token
+   * range and a recorded LexError; the other inputs are unaffected.
+   * max_threads == 0 picks the hardware concurrency; 1 disables threading.
+   */
+  void lex(const std::vector<std::string> &inputs, size_t max_threads = 0) {
+    m_tokens.clear();
+    m_entries.clear();
+    m_errors.clear();
+    m_source.clear();
+
+    // copy every input into the shared buffer first, so that token string
+    // refs are never invalidated by a reallocation while lexing
+    size_t total_size = 0;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+      total_size += inputs[i].size();
+    }
+    m_source.reserve(total_size);
+    m_entries.resize(inputs.size());
+    for (size_t i = 0; i < inputs.size(); ++i) {
+      Entry &entry = m_entries[i];
+      entry.source_offset = m_source.size();
+      entry.source_length = inputs[i].size();
+      entry.token_offset = 0;
+      entry.token_count = 0;
+      entry.error_index = -1;
+      m_source.insert(m_source.end(), inputs[i].begin(), inputs[i].end());
+    }
+
+#if defined(LEXER_HAS_THREADS)
+    size_t num_threads = max_threads;
+    if (num_threads == 0) {
+      num_threads = std::thread::hardware_concurrency();
+    }
+    if (inputs.size() >= parallel_threshold && num_threads > 1) {
+      lex_parallel(num_threads);
+      return;
+    }
+#else
+    (void)max_threads;
+#endif
+
+    m_tokens.reserve(total_size / 5 + inputs.size());
+    lex_range(0, m_entries.size(), m_tokens, m_errors);
+  }
+
+  size_t size() const { return m_entries.size(); }
+
+  const Entry &get_entry(size_t input) const { return m_entries[input]; }
+  const std::vector<Entry> &get_entries() const { return m_entries; }
+  const std::vector<Token> &get_tokens() const { return m_tokens; }
+  const std::vector<LexError> &get_errors() const { return m_errors; }
+
+  // token range for one input; begin == end if lexing it failed
+  const Token *tokens_begin(size_t input) const {
+    return m_tokens.empty() ? nullptr
+                            : &m_tokens[0] + m_entries[input].token_offset;
+  }
+  const Token *tokens_end(size_t input) const {
+    return tokens_begin(input) + m_entries[input].token_count;
+  }
+  size_t get_token_count(size_t input) const {
+    return m_entries[input].token_count;
+  }
+
+  bool has_error(size_t input) const {
+    return m_entries[input].error_index >= 0;
+  }
+  const LexError *get_error(size_t input) const {
+    int idx = m_entries[input].error_index;
+    return idx >= 0 ? &m_errors[static_cast<size_t>(idx)] : nullptr;
+  }
+
+  // raw source text of one input (points into the shared buffer)
+  StringRef get_source(size_t input) const {
+    StringRef ref;
+    ref.start = m_source.empty()
+                    ? nullptr
+                    : &m_source[0] + m_entries[input].source_offset;
+    ref.length = m_entries[input].source_length;
+    return ref;
+  }
+
+private:
+  // private copy constructor and assignment operator to prevent copying
+  TokenBatch(const TokenBatch &);
+  TokenBatch &operator=(const TokenBatch &);
+
+  // lexes entries [first, last) into out; token offsets are relative to out
+  void lex_range(size_t first, size_t last, std::vector<Token> &out,
+                 std::vector<LexError> &errors) {
+    static const std::string batch_filename("<batch>");
+    const char *base = m_source.empty() ? nullptr : &m_source[0];
+    for (size_t i = first; i < last; ++i) {
+      Entry &entry = m_entries[i];
+      entry.token_offset = out.size();
+      Lexer lexer(batch_filename, base ? base + entry.source_offset : nullptr,
+                  entry.source_length, out);
+      try {
+        while (!lexer.is_done()) {
+          lexer.lex_next();
+        }
+      } catch (const LexError &e) {
+        out.erase(out.begin() + entry.token_offset, out.end());
+        entry.error_index = static_cast<int>(errors.size());
+        errors.push_back(e);
+      }
+      entry.token_count = out.size() - entry.token_offset;
+    }
+  }
+
+#if defined(LEXER_HAS_THREADS)
+  // splits the entries into contiguous chunks, lexes each chunk on its own
+  // thread, then concatenates the per-thread outputs into the arena
+  void lex_parallel(size_t num_threads) {
+    if (num_threads > m_entries.size()) {
+      num_threads = m_entries.size();
+    }
+    m_worker_tokens.resize(num_threads);
+    m_worker_errors.resize(num_threads);
+    std::vector<std::exception_ptr> failures(num_threads);
+    std::vector<std::thread> workers;
+    workers.reserve(num_threads);
+
+    const size_t chunk = (m_entries.size() + num_threads - 1) / num_threads;
+    for (size_t t = 0; t < num_threads; ++t) {
+      size_t first = t * chunk;
+      size_t last = std::min(first + chunk, m_entries.size());
+      m_worker_tokens[t].clear();
+      m_worker_errors[t].clear();
+      workers.push_back(std::thread(&TokenBatch::lex_worker, this, t, first,
+                                    last, &failures[t]));
+    }
+    for (size_t t = 0; t < workers.size(); ++t) {
+      workers[t].join();
+    }
+    for (size_t t = 0; t < failures.size(); ++t) {
+      if (failures[t]) {
+        std::rethrow_exception(failures[t]);
+      }
+    }
+
+    size_t total_tokens = 0;
+    for (size_t t = 0; t < num_threads; ++t) {
+      total_tokens += m_worker_tokens[t].size();
+    }
+    m_tokens.reserve(total_tokens);
+    for (size_t t = 0; t < num_threads; ++t) {
+      size_t first = t * chunk;
+      size_t last = std::min(first + chunk, m_entries.size());
+      size_t token_base = m_tokens.size();
+      int error_base = static_cast<int>(m_errors.size());
+      for (size_t i = first; i < last; ++i) {
+        m_entries[i].token_offset += token_base;
+        if (m_entries[i].error_index >= 0) {
+          m_entries[i].error_index += error_base;
+        }
+      }
+      m_tokens.insert(m_tokens.end(), m_worker_tokens[t].begin(),
+                      m_worker_tokens[t].end());
+      m_errors.insert(m_errors.end(), m_worker_errors[t].begin(),
+                      m_worker_errors[t].end());
+    }
+  }
+
+  void lex_worker(size_t t, size_t first, size_t last,
+                  std::exception_ptr *failure) {
+    try {
+      lex_range(first, last, m_worker_tokens[t], m_worker_errors[t]);
+    } catch (...) {
+      *failure = std::current_exception();
+    }
+  }
+
+  std::vector<std::vector<Token> > m_worker_tokens;
+  std::vector<std::vector<LexError> > m_worker_errors;
+#endif
+
+  std::vector<char> m_source;     // shared copy of every input
+  std::vector<Token> m_tokens;    // token arena for all inputs
+  std::vector<Entry> m_entries;   // per-input ranges
+  std::vector<LexError> m_errors; // errors for inputs that failed to lex
+};
+
+/**
+ * lexes unbounded input (stdin, pipes) in fixed-size chunks.
+ * the lexer sees a window made of the bytes carried over from the previous
+ * window plus one new chunk; while a window is lexed, the next chunk is read
+ * ahead into a second buffer (on a background thread when available).
+ * tokens that may continue past the end of the window are not emitted: the
+ * lexer rewinds to before them and their bytes are carried into the next
+ * window. whitespace and comments are dropped as they arrive, so memory
+ * stays bounded by two chunks plus the longest token.
+ * with read-ahead, the destructor waits for a read in progress, which on a
+ * terminal or a stalled pipe lasts until more input or end of input. pass
+ * read_ahead = false for such streams: the stream is then only read inside
+ * next_tokens(), and destroying the lexer (also while an exception unwinds)
+ * never blocks.
+ * note: spans are absolute stream offsets; string refs point into the
+ * window and are only valid until the next call to next_tokens().
+ */
+class StreamLexer {
+public:
+  static const size_t default_chunk_size = 64 * 1024;
+
+  explicit StreamLexer(std::istream &in,
+                       const std::string &filename = "<stdin>",
+                       size_t chunk_size = default_chunk_size,
+                       bool read_ahead = true)
+      : m_in(in), m_filename(filename),
+        m_chunk_size(chunk_size ? chunk_size : 1), m_window_size(0),
+        m_base(0), m_consumed(0), m_input_done(false), m_finished(false),
+        m_in_comment(false), m_ahead(m_chunk_size), m_ahead_size(0),
+        m_reading(false) {
+    m_carry_state.pos = 0;
+    m_carry_state.line = 1;
+    m_carry_state.col = 1;
+#if defined(LEXER_HAS_THREADS)
+    m_read_requested = false;
+    m_chunk_ready = false;
+    m_stop = false;
+    if (read_ahead) {
+      m_reader = std::thread(&StreamLexer::reader_loop, this);
+    }
+#else
+    (void)read_ahead; // reads are always synchronous without threads
+#endif
+    start_read_ahead();
+  }
+
+  ~StreamLexer() {
+#if defined(LEXER_HAS_THREADS)
+    if (m_reader.joinable()) {
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_stop = true;
+        m_wake.notify_all();
+      }
+      m_reader.join();
+    }
+#endif
+  }
+
+  /**
+   * replaces out with the next run of complete tokens.
+   * returns false once the whole input has been lexed; the last run that
+   * returns true ends with TokEof. throws LexError on invalid input, and
+   * rethrows any exception raised while reading the stream.
+   */
+  bool next_tokens(std::vector<Token> &out) {
+    out.clear();
+    while (out.empty() && !m_finished) {
+      fill_window();
+      lex_window(out);
+    }
+    return !out.empty();
+  }
+
+  // absolute offset of the first byte currently held in the window
+  size_t get_window_offset() const { return m_base; }
+  // bytes allocated for the window; bounded by two chunks plus the longest
+  // token
+  size_t get_buffer_size() const { return m_window.size(); }
+
+private:
+  // private copy constructor and assignment operator to prevent copying
+  StreamLexer(const StreamLexer &);
+  StreamLexer &operator=(const StreamLexer &);
+
+  // the lexer looks at most this many characters past a token's end
+  static const size_t lookahead_margin = 3;
+
+  // drops the bytes lexed last time (the tokens handed out are no longer
+  // needed), appends the chunk that was read ahead, starts reading the next
+  // one and drops the whitespace and comments the window now starts with
+  void fill_window() {
+    drop_consumed();
+    finish_read_ahead();
+    if (m_ahead_size == 0) {
+      m_input_done = true;
+    } else {
+      if (m_window.size() < m_window_size + m_ahead_size) {
+        m_window.resize(m_window_size + m_ahead_size);
+      }
+      std::memcpy(&m_window[0] + m_window_size, &m_ahead[0], m_ahead_size);
+      m_window_size += m_ahead_size;
+      start_read_ahead();
+    }
+    skip_trivia();
+    drop_consumed();
+  }
+
+  // removes the first m_consumed bytes from the window
+  void drop_consumed() {
+    if (m_consumed > 0) {
+      std::memmove(&m_window[0], &m_window[0] + m_consumed,
+                   m_window_size - m_consumed);
+      m_window_size -= m_consumed;
+      m_base += m_consumed;
+      m_consumed = 0;
+    }
+  }
+
+  // marks leading whitespace and // comments as consumed, continuing a
+  // comment that ran past the previous window's end (m_in_comment). a '/'
+  // at the window end is kept until the next byte tells what it starts.
+  void skip_trivia() {
+    InputIter iter(m_filename, m_window_size ? &m_window[0] : nullptr,
+                   m_window_size);
+    iter.restore(m_carry_state);
+    while (iter.has_more()) {
+      char c = iter.current();
+      if (m_in_comment && c != '\n') {
+        iter.next();
+      } else if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+        m_in_comment = false;
+        iter.next();
+      } else if (c == '/' && iter.peek() == '/') {
+        m_in_comment = true;
+        iter.next2();
+      } else {
+        break;
+      }
+    }
+    m_consumed = iter.position();
+    m_carry_state = iter.save();
+    m_carry_state.pos = 0;
+  }
+
+  void lex_window(std::vector<Token> &out) {
+    const char *data = m_window_size ? &m_window[0] : nullptr;
+    Lexer lexer(m_filename, data, m_window_size, out);
+    // continue line/column numbering from the carried-over bytes
+    Lexer::Checkpoint cp;
+    cp.iter_state = m_carry_state;
+    cp.token_count = 0;
+    cp.done = false;
+    lexer.rewind(cp);
+
+    while (true) {
+      cp = lexer.checkpoint();
+      try {
+        const Token &token = lexer.lex_next();
+        if (m_input_done) {
+          if (token.get_kind() == TokEof) {
+            m_finished = true;
+            break;
+          }
+          continue;
+        }
+        // a token near the window end might continue in the next chunk
+        if (token.get_kind() == TokEof ||
+            token.get_span().end + lookahead_margin > m_window_size) {
+          lexer.rewind(cp);
+          break;
+        }
+      } catch (const LexError &) {
+        // errors caused by hitting the window end are retried with more
+        // input; errors well inside the window are real
+        if (m_input_done ||
+            lexer.get_position() + lookahead_margin <= m_window_size) {
+          throw;
+        }
+        lexer.rewind(cp);
+        break;
+      }
+    }
+
+    // make spans absolute stream offsets
+    for (size_t i = 0; i < out.size(); ++i) {
+      const Span &span = out[i].get_span();
+      out[i].set_span(Span(span.start + m_base, span.end + m_base));
+    }
+
+    // the unlexed tail is carried over to the front of the next window
+    if (!m_finished) {
+      m_consumed = cp.iter_state.pos;
+      m_carry_state = cp.iter_state;
+      m_carry_state.pos = 0;
+    }
+  }
+
+  void read_chunk() {
+    m_ahead_size = 0;
+    m_in.read(&m_ahead[0], static_cast<std::streamsize>(m_chunk_size));
+    m_ahead_size = static_cast<size_t>(m_in.gcount());
+  }
+
+#if defined(LEXER_HAS_THREADS)
+  // body of the reader thread: reads one chunk per request until stopped.
+  // exceptions are handed to the consumer instead of escaping the thread.
+  void reader_loop() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+      while (!m_read_requested && !m_stop) {
+        m_wake.wait(lock);
+      }
+      if (m_stop) {
+        return;
+      }
+      m_read_requested = false;
+      lock.unlock();
+      std::exception_ptr error;
+      try {
+        read_chunk();
+      } catch (...) {
+        error = std::current_exception();
+      }
+      lock.lock();
+      m_read_error = error;
+      m_chunk_ready = true;
+      m_done.notify_all();
+    }
+  }
+#endif
+
+  // requests the next chunk: the reader thread starts on it at once;
+  // without one, it is read when finish_read_ahead() needs it
+  void start_read_ahead() {
+    m_reading = true;
+#if defined(LEXER_HAS_THREADS)
+    if (m_reader.joinable()) {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_read_requested = true;
+      m_wake.notify_all();
+    }
+#endif
+  }
+
+  void finish_read_ahead() {
+    if (!m_reading) {
+      return;
+    }
+    m_reading = false;
+#if defined(LEXER_HAS_THREADS)
+    if (m_reader.joinable()) {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      while (!m_chunk_ready) {
+        m_done.wait(lock);
+      }
+      m_chunk_ready = false;
+      if (m_read_error) {
+        std::exception_ptr error = m_read_error;
+        m_read_error = std::exception_ptr();
+        std::rethrow_exception(error);
+      }
+      return;
+    }
+#endif
+    read_chunk();
+  }
+
+  std::istream &m_in;
+  std::string m_filename;
+  size_t m_chunk_size;
+
+  std::vector<char> m_window;     // carried bytes + current chunk
+  size_t m_window_size;           // bytes of m_window in use
+  size_t m_base;                  // stream offset of m_window[0]
+  size_t m_consumed;              // bytes of m_window already lexed
+  InputIter::State m_carry_state; // line/column at the window start
+  bool m_input_done;              // the stream has been fully read
+  bool m_finished;                // TokEof has been emitted
+  bool m_in_comment;              // the window end is inside a // comment
+
+  std::vector<char> m_ahead; // read-ahead buffer for the next chunk
+  size_t m_ahead_size;
+  bool m_reading;            // a chunk has been requested, not collected
+#if defined(LEXER_HAS_THREADS)
+  // with read-ahead, one reader thread lives as long as the lexer; requests
+  // and results are handed over under m_mutex
+  std::mutex m_mutex;
+  std::condition_variable m_wake; // signalled on a request or stop
+  std::condition_variable m_done; // signalled when a chunk is ready
+  bool m_read_requested;
+  bool m_chunk_ready;
+  bool m_stop;
+  std::exception_ptr m_read_error;
+  std::thread m_reader;
+#endif
+};
+
+/**
+ * read-only view of a whole file, memory-mapped where supported.
+ */
+class MappedFile {
+public:
+  MappedFile() : m_data(nullptr), m_size(0), m_open(false), m_mapped(false) {}
+  ~MappedFile() { close(); }
+
+  // maps the file; returns false if it cannot be opened or mapped
+  bool open(const std::string &path) {
+    close();
+#if !defined(LEXER_NO_MMAP)
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+      ::close(fd);
+      return false;
+    }
+    m_size = static_cast<size_t>(st.st_size);
+    if (m_size > 0) {
+      void *addr = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (addr == MAP_FAILED) {
+        ::close(fd);
+        m_size = 0;
+        return false;
+      }
+      m_data = static_cast<const char *>(addr);
+      m_mapped = true;
+    }
+    ::close(fd); // the mapping stays valid after closing the descriptor
+#else
+    std::ifstream file(path.c_str(), std::ios::binary);
+    if (!file.is_open()) {
+      return false;
+    }
+    m_buffer.assign(std::istreambuf_iterator<char>(file),
+                    std::istreambuf_iterator<char>());
+    m_size = m_buffer.size();
+    m_data = m_buffer.empty() ? nullptr : &m_buffer[0];
+#endif
+    m_open = true;
+    return true;
+  }
+
+  void close() {
+#if !defined(LEXER_NO_MMAP)
+    if (m_mapped) {
+      ::munmap(const_cast<char *>(m_data), m_size);
+    }
+#else
+    m_buffer.clear();
+#endif
+    m_data = nullptr;
+    m_size = 0;
+    m_open = false;
+    m_mapped = false;
+  }
+
+  bool is_open() const { return m_open; }
+  const char *get_data() const { return m_data; }
+  size_t get_size() const { return m_size; }
+
+private:
+  // private copy constructor and assignment operator to prevent copying
+  MappedFile(const MappedFile &);
+  MappedFile &operator=(const MappedFile &);
+
+  const char *m_data;
+  size_t m_size;
+  bool m_open;
+  bool m_mapped;
+#if defined(LEXER_NO_MMAP)
+  std::vector<char> m_buffer;
+#endif
+};
+
+// 64-bit FNV-1a hash, used to key and checksum cached token streams
+inline unsigned long long fnv1a_64(const char *data, size_t len,
+                                   unsigned long long hash =
+                                       14695981039346656037ULL) {
+  for (size_t i = 0; i < len; ++i) {
+    hash ^= static_cast<unsigned char>(data[i]);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+/**
+ * persistent on-disk cache of token streams, keyed by source content.
+ * each entry is a compact binary file: a versioned header (magic, format
+ * version, source size/hash, token count, checksum of the records)
+ * followed by one fixed-size little-endian record per token. string refs
+ * are stored as offsets into the source and turned back into pointers on
+ * load. an entry whose records do not match the checksum is rejected, and
+ * every record is also bounds-checked against the source as it is decoded.
+ * note: the cache directory must already exist.
+ */
+class TokenCache {
+public:
+  static const unsigned int format_version = 4;
+  static const size_t header_size = 48;
+  static const size_t record_size = 40;
+
+  explicit TokenCache(const std::string &directory) : m_dir(directory) {}
+
+  const std::string &get_directory() const { return m_dir; }
+
+  // path of the cache entry for a source's current content
+  std::string get_entry_path(const Src &source) const {
+    return entry_path(hash_source(source));
+  }
+
+  /**
+   * loads the cached tokens for source into tokens, reusing its capacity.
+   * returns false on a miss, a version mismatch or a corrupt entry; tokens
+   * is left untouched unless the records pass the checksum but one fails its
+   * bounds check, which leaves it empty. loaded tokens point into source.
+   */
+  bool load(const Src &source, std::vector<Token> &tokens) const {
+    const unsigned long long hash = hash_source(source);
+    MappedFile file;
+    if (!file.open(entry_path(hash)) || file.get_size() < header_size) {
+      return false;
+    }
+    const char *data = file.get_data();
+    const size_t code_size = source.get_code().size();
+    if (std::memcmp(data, "LXTC", 4) != 0 ||
+        get_u32(data + 4) != format_version ||
+        get_u32(data + 8) != record_size ||
+        get_u64(data + 16) != code_size || get_u64(data + 24) != hash) {
+      return false;
+    }
+    unsigned long long count = get_u64(data + 32);
+    if (count != (file.get_size() - header_size) / record_size ||
+        file.get_size() != header_size + count * record_size) {
+      return false;
+    }
+    const char *records = data + header_size;
+    if (get_u64(data + 40) !=
+        fnv1a_64(records, static_cast<size_t>(count) * record_size)) {
+      return false;
+    }
+
+    const char *code = source.get_code_ptr();
+    tokens.clear();
+    tokens.reserve(static_cast<size_t>(count));
+    for (size_t i = 0; i < count; ++i) {
+      const char *rec = records + i * record_size;
+      unsigned int kind_value = get_u32(rec);
+      unsigned int aux = get_u32(rec + 4);
+      Span span(static_cast<size_t>(get_u64(rec + 8)),
+                static_cast<size_t>(get_u64(rec + 16)));
+      unsigned long long payload = get_u64(rec + 24);
+      unsigned long long length = get_u64(rec + 32);
+      if (kind_value > static_cast<unsigned int>(TokDotDot) ||
+          span.start > span.end || span.end > code_size) {
+        tokens.clear();
+        return false;
+      }
+      TokenKind kind = static_cast<TokenKind>(kind_value);
+      switch (kind) {
+      case TokId:
+      case TokStrLit:
+      case TokFlagShort:
+      case TokFlagLong: {
+        if (payload > code_size || length > code_size - payload) {
+          tokens.clear();
+          return false;
+        }
+        const char *ptr = code + payload;
+        size_t len = static_cast<size_t>(length);
+        if (kind == TokId) {
+          tokens.push_back(Token::make_id(ptr, len, span));
+        } else if (kind == TokStrLit) {
+          tokens.push_back(Token::make_str_lit(ptr, len, span));
+        } else if (kind == TokFlagShort) {
+          tokens.push_back(Token::make_short_flag(ptr, len, span));
+        } else {
+          tokens.push_back(Token::make_long_flag(ptr, len, span));
+        }
+        break;
+      }
+      case TokIntLit:
+        if (aux != Dec && aux != Bin && aux != Hex) {
+          tokens.clear();
+          return false;
+        }
+        tokens.push_back(Token::make_int_lit(static_cast<long long>(payload),
+                                             static_cast<Radix>(aux), span));
+        break;
+      case TokFloatLit: {
+        double value;
+        std::memcpy(&value, &payload, sizeof(value));
+        tokens.push_back(Token::make_float_lit(value, aux != 0, span));
+        break;
+      }
+      default:
+        tokens.push_back(Token(kind, span));
+        break;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * writes the token stream for source to the cache.
+   * the entry is written to a uniquely named temporary file and renamed into
+   * place, so a concurrent reader never sees a half-written entry and
+   * concurrent writers never share a temporary file.
+   * tokens must point into source (as produced by Lexer::tokenize).
+   */
+  void store(const Src &source, const std::vector<Token> &tokens) const {
+    const char *code = source.get_code_ptr();
+    std::string records;
+    records.resize(tokens.size() * record_size);
+    for (size_t i = 0; i < tokens.size(); ++i) {
+      const Token &token = tokens[i];
+      char *rec = &records[0] + i * record_size;
+      unsigned int aux = 0;
+      unsigned long long payload = 0;
+      unsigned long long length = 0;
+      switch (token.get_kind()) {
+      case TokId:
+      case TokStrLit:
+      case TokFlagShort:
+      case TokFlagLong:
+        payload = static_cast<unsigned long long>(
+            token.get_string_ref_start() - code);
+        length = token.get_string_ref_length();
+        break;
+      case TokIntLit:
+        aux = static_cast<unsigned int>(token.get_int_base());
+        payload = static_cast<unsigned long long>(token.get_int_value());
+        break;
+      case TokFloatLit: {
+        double value = token.get_float_value();
+        aux = token.has_float_exponent() ? 1 : 0;
+        std::memcpy(&payload, &value, sizeof(value));
+        break;
+      }
+      default:
+        break;
+      }
+      put_u32(rec, static_cast<unsigned int>(token.get_kind()));
+      put_u32(rec + 4, aux);
+      put_u64(rec + 8, token.get_span().start);
+      put_u64(rec + 16, token.get_span().end);
+      put_u64(rec + 24, payload);
+      put_u64(rec + 32, length);
+    }
+
+    char header[header_size];
+    std::memset(header, 0, sizeof(header));
+    std::memcpy(header, "LXTC", 4);
+    put_u32(header + 4, format_version);
+    put_u32(header + 8, record_size);
+    put_u64(header + 16, source.get_code().size());
+    const unsigned long long hash = hash_source(source);
+    put_u64(header + 24, hash);
+    put_u64(header + 32, tokens.size());
+    put_u64(header + 40, fnv1a_64(records.data(), records.size()));
+
+    std::string path = entry_path(hash);
+    std::string tmp_path = temp_path(path);
+    {
+      std::ofstream out(tmp_path.c_str(), std::ios::binary | std::ios::trunc);
+      if (!out.is_open()) {
+        throw std::runtime_error("could not write token cache: " + tmp_path);
+      }
+      out.write(header, sizeof(header));
+      out.write(records.data(), static_cast<std::streamsize>(records.size()));
+      out.close();
+      if (!out) {
+        std::remove(tmp_path.c_str());
+        throw std::runtime_error("error writing token cache: " + tmp_path);
+      }
+    }
+#if defined(_WIN32)
+    // rename does not replace files on windows; elsewhere it replaces the
+    // entry atomically, so readers never see it missing
+    std::remove(path.c_str());
+#endif
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+      std::remove(tmp_path.c_str());
+      throw std::runtime_error("could not write token cache: " + path);
+    }
+  }
+
+  // removes the cache entry for source; returns true if one existed
+  bool invalidate(const Src &source) const {
+    return std::remove(get_entry_path(source).c_str()) == 0;
+  }
+
+  /**
+   * returns the tokens for source, loading them from the cache when
+   * possible and lexing (then storing) them otherwise. a failed store
+   * (e.g., a missing or read-only cache directory) only costs the caching;
+   * the lexed tokens are still returned.
+   */
+  std::vector<Token> tokenize(const Src &source) const {
+    std::vector<Token> tokens;
+    if (!load(source, tokens)) {
+      tokens = Lexer::tokenize(source);
+      try {
+        store(source, tokens);
+      } catch (const std::runtime_error &) {
+      }
+    }
+    return tokens;
+  }
+
+private:
+  static unsigned long long hash_source(const Src &source) {
+    return fnv1a_64(source.get_code_ptr(), source.get_code().size());
+  }
+
+  std::string entry_path(unsigned long long hash) const {
+    static const char hex_digits[] = "0123456789abcdef";
+    char name[17];
+    for (int i = 15; i >= 0; --i) {
+      name[i] = hex_digits[hash & 0xf];
+      hash >>= 4;
+    }
+    name[16] = '\0';
+    std::string path = m_dir;
+    if (!path.empty() && path[path.size() - 1] != '/') {
+      path += '/';
+    }
+    return path + name + ".tokc";
+  }
+
+  // <entry>.<pid>.<counter>.tmp: unique per process and per store call
+  static std::string temp_path(const std::string &path) {
+#if defined(LEXER_HAS_THREADS)
+    static std::atomic<unsigned long> counter(0);
+    unsigned long id = counter.fetch_add(1);
+#else
+    static unsigned long counter = 0;
+    unsigned long id = counter++;
+#endif
+#if defined(_WIN32)
+    long pid = static_cast<long>(_getpid());
+#else
+    long pid = static_cast<long>(getpid());
+#endif
+    std::ostringstream name;
+    name << path << '.' << pid << '.' << id << ".tmp";
+    return name.str();
+  }
+
+  // fixed little-endian encoding, independent of host byte order
+  static void put_u32(char *dst, unsigned int value) {
+    for (int i = 0; i < 4; ++i) {
+      dst[i] = static_cast<char>((value >> (8 * i)) & 0xff);
+    }
+  }
+  static void put_u64(char *dst, unsigned long long value) {
+    for (int i = 0; i < 8; ++i) {
+      dst[i] = static_cast<char>((value >> (8 * i)) & 0xff);
+    }
+  }
+  static unsigned int get_u32(const char *src) {
+    unsigned int value = 0;
+    for (int i = 3; i >= 0; --i) {
+      value = (value << 8) | static_cast<unsigned char>(src[i]);
+    }
+    return value;
+  }
+  static unsigned long long get_u64(const char *src) {
+    unsigned long long value = 0;
+    for (int i = 7; i >= 0; --i) {
+      value = (value << 8) | static_cast<unsigned char>(src[i]);
+    }
+    return value;
+  }
+
+  std::string m_dir;
 };
 
 } // namespace lexer
@@ -27,12 +27,14 @@ SOFTWARE.
 
 #include "lexer.hpp"
 #include <algorithm>
+#include <climits>
 #include <cstdlib>
 #include <cstring>
 #include <iomanip>
 #include <iostream>
 #include <map>
 #include <memory>
+#include <new>
 #include <sstream>
 #include <stdexcept>
 #include <string>
@@ -59,6 +61,17 @@ SOFTWARE.
 #define PARSER_USE_TR1_SHARED_PTR
 #endif
 
+// static_assert gives typed handles (ArgHandle<T>) a readable compile error
+// for unsupported value types; older compilers report an incomplete type.
+#if __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1600)
+#define PARSER_HAS_STATIC_ASSERT
+#endif
+
+// rvalue references and noexcept: ArgValue gets move construction/assignment
+#if __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1900)
+#define PARSER_HAS_RVALUE_REFS
+#endif
+
 namespace parser {
 
 // Levenshtein distance for suggestions
@@ -105,6 +118,288 @@ inline std::vector<std::string> make_aliases(const char *a1 = 0,
   return v;
 }
 
+/**
+ * open-addressing hash table from names to dense slot numbers.
+ * built once per command schema; lookups take a pointer/length pair so
+ * they never allocate (e.g., directly from a token's string ref).
+ */
+class SlotTable {
+public:
+  static const size_t npos = static_cast<size_t>(-1);
+
+  SlotTable() : m_count(0) {}
+
+  void clear() {
+    m_entries.clear();
+    m_count = 0;
+  }
+
+  size_t size() const { return m_count; }
+
+  // inserts key -> slot; returns false (and keeps the old slot) if the key
+  // already exists
+  bool insert(const std::string &key, size_t slot) {
+    if ((m_count + 1) * 2 > m_entries.size()) {
+      grow();
+    }
+    size_t mask = m_entries.size() - 1;
+    unsigned long long hash = lexer::fnv1a_64(key.data(), key.size());
+    for (size_t i = static_cast<size_t>(hash) & mask;; i = (i + 1) & mask) {
+      Entry &entry = m_entries[i];
+      if (!entry.used) {
+        entry.used = true;
+        entry.hash = hash;
+        entry.key = key;
+        entry.slot = slot;
+        m_count++;
+        return true;
+      }
+      if (entry.hash == hash && entry.key == key) {
+        return false;
+      }
+    }
+  }
+
+  // replaces the slot of an existing key (or inserts it)
+  void assign(const std::string &key, size_t slot) {
+    if (!insert(key, slot)) {
+      m_entries[locate(key.data(), key.size())].slot = slot;
+    }
+  }
+
+  // returns the slot for key, or npos
+  size_t find(const char *key, size_t len) const {
+    if (m_count == 0) {
+      return npos;
+    }
+    size_t i = locate(key, len);
+    return i == npos ? npos : m_entries[i].slot;
+  }
+
+  size_t find(const std::string &key) const {
+    return find(key.data(), key.size());
+  }
+
+private:
+  struct Entry {
+    bool used;
+    unsigned long long hash;
+    std::string key;
+    size_t slot;
+
+    Entry() : used(false), hash(0), slot(0) {}
+  };
+
+  size_t locate(const char *key, size_t len) const {
+    size_t mask = m_entries.size() - 1;
+    unsigned long long hash = lexer::fnv1a_64(key, len);
+    for (size_t i = static_cast<size_t>(hash) & mask;; i = (i + 1) & mask) {
+      const Entry &entry = m_entries[i];
+      if (!entry.used) {
+        return npos;
+      }
+      if (entry.hash == hash && entry.key.size() == len &&
+          (len == 0 || std::memcmp(entry.key.data(), key, len) == 0)) {
+        return i;
+      }
+    }
+  }
+
+  void grow() {
+    std::vector<Entry> old;
+    old.swap(m_entries);
+    m_entries.resize(old.empty() ? 16 : old.size() * 2);
+    m_count = 0;
+    size_t mask = m_entries.size() - 1;
+    for (size_t j = 0; j < old.size(); ++j) {
+      if (!old[j].used) {
+        continue;
+      }
+      size_t i = static_cast<size_t>(old[j].hash) & mask;
+      while (m_entries[i].used) {
+        i = (i + 1) & mask;
+      }
+      m_entries[i].used = true;
+      m_entries[i].hash = old[j].hash;
+      m_entries[i].key.swap(old[j].key);
+      m_entries[i].slot = old[j].slot;
+      m_count++;
+    }
+  }
+
+  std::vector<Entry> m_entries; // power-of-two capacity, at most half full
+  size_t m_count;
+};
+
+/**
+ * perfect hash over a fixed set of strings (an argument's choices): the
+ * seed is searched when the table is built so that every key lands in its
+ * own bucket, and a lookup is one hash, one probe and one compare. keys
+ * map to their ordinal (index in the list given to build).
+ */
+class ChoiceTable {
+public:
+  static const size_t npos = static_cast<size_t>(-1);
+
+  ChoiceTable() : m_seed(0), m_mask(0) {}
+
+  // keys must be distinct
+  void build(const std::vector<std::string> &keys) {
+    m_keys = keys;
+    m_buckets.clear();
+    m_mask = 0;
+    m_seed = 0;
+    if (keys.empty()) {
+      return;
+    }
+    size_t size = 2;
+    while (size < keys.size() * 2) {
+      size *= 2;
+    }
+    // a few hundred seeds per size; doubling makes collisions ever rarer
+    for (;; size *= 2) {
+      m_buckets.assign(size, size_t(npos));
+      m_mask = size - 1;
+      for (m_seed = 0; m_seed < 256; ++m_seed) {
+        if (place_all()) {
+          return;
+        }
+      }
+    }
+  }
+
+  bool empty() const { return m_keys.empty(); }
+  const std::vector<std::string> &get_keys() const { return m_keys; }
+
+  // ordinal of key, or npos
+  size_t find(const char *key, size_t len) const {
+    if (m_buckets.empty()) {
+      return npos;
+    }
+    size_t ordinal = m_buckets[bucket(key, len)];
+    if (ordinal == npos || m_keys[ordinal].size() != len ||
+        (len != 0 && std::memcmp(m_keys[ordinal].data(), key, len) != 0)) {
+      return npos;
+    }
+    return ordinal;
+  }
+
+  size_t find(const std::string &key) const {
+    return find(key.data(), key.size());
+  }
+
+private:
+  size_t bucket(const char *key, size_t len) const {
+    unsigned long long basis =
+        14695981039346656037ULL ^ (m_seed * 0x9e3779b97f4a7c15ULL);
+    return static_cast<size_t>(lexer::fnv1a_64(key, len, basis)) & m_mask;
+  }
+
+  bool place_all() {
+    std::fill(m_buckets.begin(), m_buckets.end(), size_t(npos));
+    for (size_t i = 0; i < m_keys.size(); ++i) {
+      size_t &entry = m_buckets[bucket(m_keys[i].data(), m_keys[i].size())];
+      if (entry != npos) {
+        return false;
+      }
+      entry = i;
+    }
+    return true;
+  }
+
+  std::vector<std::string> m_keys;
+  std::vector<size_t> m_buckets; // ordinal per bucket, npos if empty
+  unsigned long long m_seed;
+  size_t m_mask;
+};
+
+/**
+ * fixed-size bit set over argument slots (e.g., "slots that are boolean
+ * flags" or "slots seen during a parse"), stored as machine words so set
+ * operations are word-wide.
+ */
+class SlotSet {
+public:
+  static const size_t bits_per_word = sizeof(unsigned long) * CHAR_BIT;
+
+  SlotSet() : m_num_slots(0) {}
+  explicit SlotSet(size_t num_slots) { resize(num_slots); }
+
+  // resize to num_slots and clear every bit (keeps capacity)
+  void resize(size_t num_slots) {
+    m_num_slots = num_slots;
+    m_words.assign((num_slots + bits_per_word - 1) / bits_per_word, 0UL);
+  }
+
+  // clear every bit
+  void reset() { std::fill(m_words.begin(), m_words.end(), 0UL); }
+
+  size_t size() const { return m_num_slots; }
+
+  void set(size_t slot) {
+    m_words[slot / bits_per_word] |= 1UL << (slot % bits_per_word);
+  }
+  void unset(size_t slot) {
+    m_words[slot / bits_per_word] &= ~(1UL << (slot % bits_per_word));
+  }
+  bool test(size_t slot) const {
+    return slot < m_num_slots &&
+           (m_words[slot / bits_per_word] >> (slot % bits_per_word)) & 1UL;
+  }
+
+  bool any() const {
+    for (size_t i = 0; i < m_words.size(); ++i) {
+      if (m_words[i]) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // number of slots set in both sets (sets must be the same size)
+  size_t count_and(const SlotSet &other) const {
+    size_t count = 0;
+    for (size_t i = 0; i < m_words.size(); ++i) {
+      for (unsigned long w = m_words[i] & other.m_words[i]; w; w &= w - 1) {
+        ++count;
+      }
+    }
+    return count;
+  }
+
+  // true if every slot set in other is also set here
+  bool contains(const SlotSet &other) const {
+    for (size_t i = 0; i < m_words.size(); ++i) {
+      if (other.m_words[i] & ~m_words[i]) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // first slot set in other but not here, or size() if there is none
+  size_t first_missing(const SlotSet &other) const {
+    for (size_t i = 0; i < m_words.size(); ++i) {
+      unsigned long w = other.m_words[i] & ~m_words[i];
+      if (w) {
+        size_t slot = i * bits_per_word;
+        while (!(w & 1UL)) {
+          w >>= 1;
+          ++slot;
+        }
+        return slot;
+      }
+    }
+    return m_num_slots;
+  }
+
+  const std::vector<unsigned long> &get_words() const { return m_words; }
+
+private:
+  size_t m_num_slots;
+  std::vector<unsigned long> m_words;
+};
+
 class Command;
 #if defined(PARSER_USE_TR1_SHARED_PTR)
 typedef std::tr1::shared_ptr<Command> command_ptr;
@@ -125,7 +420,9 @@ struct ArgValue {
     ValueKind_Int,
     ValueKind_Double,
     ValueKind_String,
-    ValueKind_List
+    ValueKind_List,
+    ValueKind_IntList,
+    ValueKind_DoubleList
   };
 
   ValueKind kind;
@@ -133,9 +430,14 @@ struct ArgValue {
     bool b;
     long long i; // assuming long long is available as extension, else use long
     double d;
-    std::string *s; // pointer for backwards compatibility for unions in
-                    // pre-c++11 environments
+    // ValueKind_String: a std::string constructed in place (see str()), so
+    // strings that fit its small buffer are stored without allocating. a
+    // char buffer because pre-c++11 unions cannot hold a std::string; the
+    // other members give it pointer alignment
+    char s[sizeof(std::string)];
     std::vector<std::string> *sv; // pointer for the same reason
+    std::vector<long long> *iv;   // ArgType_MultipleInt values
+    std::vector<double> *dv;      // ArgType_MultipleDouble values
   } value;
 
   // default constructor
@@ -145,12 +447,23 @@ struct ArgValue {
     value.i = 0;
   }
 
-  explicit ArgValue(bool val) : kind(ValueKind_Bool) { value.b = val; }
-  explicit ArgValue(long long val) : kind(ValueKind_Int) { value.i = val; }
-  explicit ArgValue(double val) : kind(ValueKind_Double) { value.d = val; }
-  // note: takes ownership of new string
+  explicit ArgValue(bool val) : kind(ValueKind_Bool) {
+    value.b = val;
+  }
+  explicit ArgValue(long long val) : kind(ValueKind_Int) {
+    value.i = val;
+  }
+  explicit ArgValue(double val) : kind(ValueKind_Double) {
+    value.d = val;
+  }
   explicit ArgValue(const std::string &val) : kind(ValueKind_String) {
-    value.s = new std::string(val);
+    new (value.s) std::string(val);
+  }
+  explicit ArgValue(const char *val) : kind(ValueKind_String) {
+    new (value.s) std::string(val);
+  }
+  ArgValue(const char *data, size_t length) : kind(ValueKind_String) {
+    new (value.s) std::string(data, length);
   }
   // note: takes ownership of new vector
   explicit ArgValue(const std::vector<std::string> &val)
@@ -158,10 +471,22 @@ struct ArgValue {
     value.sv = new std::vector<std::string>(val);
   }
 
+  // note: takes ownership of new vector
+  explicit ArgValue(const std::vector<long long> &val)
+      : kind(ValueKind_IntList) {
+    value.iv = new std::vector<long long>(val);
+  }
+  explicit ArgValue(const std::vector<double> &val)
+      : kind(ValueKind_DoubleList) {
+    value.dv = new std::vector<double>(val);
+  }
+
   // cleanup pointer members
   ~ArgValue() { clear(); }
 
-  ArgValue(const ArgValue &other) : kind(ValueKind_None) { copy_from(other); }
+  ArgValue(const ArgValue &other) : kind(ValueKind_None) {
+    copy_from(other);
+  }
   ArgValue &operator=(const ArgValue &other) {
     if (this != &other) {
       clear();
@@ -170,14 +495,63 @@ struct ArgValue {
     return *this;
   }
 
+#if defined(PARSER_HAS_RVALUE_REFS)
+  ArgValue(ArgValue &&other) noexcept : kind(ValueKind_None) {
+    value.i = 0;
+    swap(other);
+  }
+  ArgValue &operator=(ArgValue &&other) noexcept {
+    if (this != &other) {
+      clear();
+      swap(other);
+    }
+    return *this;
+  }
+#endif
+
+  // exchanges contents without copying strings or lists
+  void swap(ArgValue &other) {
+    if (kind == ValueKind_String && other.kind == ValueKind_String) {
+      str().swap(other.str());
+      return;
+    }
+    if (kind == ValueKind_String || other.kind == ValueKind_String) {
+      // a std::string may point into itself, so it is swapped into a new
+      // one instead of being copied bytewise
+      ArgValue &text = kind == ValueKind_String ? *this : other;
+      ArgValue &plain = kind == ValueKind_String ? other : *this;
+      const ValueKind plain_kind = plain.kind;
+      char tmp[sizeof(value)];
+      std::memcpy(tmp, &plain.value, sizeof(value));
+      new (plain.value.s) std::string();
+      plain.str().swap(text.str());
+      plain.kind = ValueKind_String;
+      text.str().~basic_string();
+      std::memcpy(&text.value, tmp, sizeof(value));
+      text.kind = plain_kind;
+      return;
+    }
+    std::swap(kind, other.kind);
+    // the remaining union members are trivially copyable
+    char tmp[sizeof(value)];
+    std::memcpy(tmp, &value, sizeof(value));
+    std::memcpy(&value, &other.value, sizeof(value));
+    std::memcpy(&other.value, tmp, sizeof(value));
+  }
+
   // helper to clear existing data (delete pointers)
   void clear() {
     if (kind == ValueKind_String) {
-      delete value.s;
-      value.s = nullptr;
+      str().~basic_string();
     } else if (kind == ValueKind_List) {
       delete value.sv;
       value.sv = nullptr;
+    } else if (kind == ValueKind_IntList) {
+      delete value.iv;
+      value.iv = nullptr;
+    } else if (kind == ValueKind_DoubleList) {
+      delete value.dv;
+      value.dv = nullptr;
     }
     kind = ValueKind_None;
     value.i = 0;
@@ -200,12 +574,20 @@ struct ArgValue {
       value.d = other.value.d;
       break;
     case ValueKind_String:
-      value.s = other.value.s ? new std::string(*other.value.s) : nullptr;
+      new (value.s) std::string(other.str());
       break;
     case ValueKind_List:
       value.sv = other.value.sv ? new std::vector<std::string>(*other.value.sv)
                                 : nullptr;
       break;
+    case ValueKind_IntList:
+      value.iv = other.value.iv ? new std::vector<long long>(*other.value.iv)
+                                : nullptr;
+      break;
+    case ValueKind_DoubleList:
+      value.dv = other.value.dv ? new std::vector<double>(*other.value.dv)
+                                : nullptr;
+      break;
     }
   }
 
@@ -216,19 +598,29 @@ struct ArgValue {
   bool is_double() const { return kind == ValueKind_Double; }
   bool is_string() const { return kind == ValueKind_String; }
   bool is_string_vector() const { return kind == ValueKind_List; }
+  bool is_int_vector() const { return kind == ValueKind_IntList; }
+  bool is_double_vector() const { return kind == ValueKind_DoubleList; }
 
   // getters (unsafe, check type first or use safe getters below)
   bool get_bool_unsafe() const { return value.b; }
   long long get_int_unsafe() const { return value.i; }
   double get_double_unsafe() const { return value.d; }
-  const std::string &get_string_unsafe() const { return *value.s; }
+  const std::string &get_string_unsafe() const { return str(); }
   const std::vector<std::string> &get_string_vector_unsafe() const {
     return *value.sv;
   }
-  std::string *get_string_ptr_unsafe() const { return value.s; }
+  std::string *get_string_ptr_unsafe() const {
+    return const_cast<std::string *>(&str());
+  }
   std::vector<std::string> *get_string_vector_ptr_unsafe() const {
     return value.sv;
   }
+  std::vector<long long> *get_int_vector_ptr_unsafe() const {
+    return value.iv;
+  }
+  std::vector<double> *get_double_vector_ptr_unsafe() const {
+    return value.dv;
+  }
 
   // safe getters (returns a pointer; nullptr if wrong type/unset)
   const bool *get_bool() const {
@@ -241,14 +633,42 @@ struct ArgValue {
     return kind == ValueKind_Double ? &value.d : nullptr;
   }
   const std::string *get_string() const {
-    return kind == ValueKind_String ? value.s : nullptr;
+    return kind == ValueKind_String ? &str() : nullptr;
+  }
+  // view of a string value ({nullptr, 0} if not a string)
+  lexer::StringRef get_string_ref() const {
+    lexer::StringRef ref;
+    ref.start = nullptr;
+    ref.length = 0;
+    if (kind == ValueKind_String) {
+      ref.start = str().data();
+      ref.length = str().size();
+    }
+    return ref;
   }
   const std::vector<std::string> *get_string_vector() const {
     return kind == ValueKind_List ? value.sv : nullptr;
   }
+  const std::vector<long long> *get_int_vector() const {
+    return kind == ValueKind_IntList ? value.iv : nullptr;
+  }
+  const std::vector<double> *get_double_vector() const {
+    return kind == ValueKind_DoubleList ? value.dv : nullptr;
+  }
   std::string get_string_value(const std::string &default_val = "") const {
-    const std::string *ptr = get_string();
-    return ptr ? *ptr : default_val;
+    return kind == ValueKind_String ? str() : default_val;
+  }
+
+  // makes this a string holding [data, data + length), reusing the current
+  // string's capacity if it already is one
+  void set_string(const char *data, size_t length) {
+    if (kind == ValueKind_String) {
+      str().assign(data, length);
+      return;
+    }
+    clear();
+    new (value.s) std::string(data, length);
+    kind = ValueKind_String;
   }
 
   void print(std::ostream &os) const {
@@ -266,7 +686,7 @@ struct ArgValue {
       os << value.d;
       break;
     case ValueKind_String:
-      os << (value.s ? *value.s : "<invalid_string>");
+      get_string_ref().print(os);
       break;
     case ValueKind_List: {
       os << "[";
@@ -278,7 +698,31 @@ struct ArgValue {
       os << "]";
       break;
     }
+    case ValueKind_IntList:
+      print_numbers(os, value.iv);
+      break;
+    case ValueKind_DoubleList:
+      print_numbers(os, value.dv);
+      break;
+    }
+  }
+
+private:
+  template <typename T>
+  static void print_numbers(std::ostream &os, const std::vector<T> *values) {
+    os << "[";
+    if (values) {
+      for (size_t j = 0; j < values->size(); ++j) {
+        os << (*values)[j] << (j == values->size() - 1 ? "" : ", ");
+      }
     }
+    os << "]";
+  }
+
+  // the in-place string of a ValueKind_String value
+  std::string &str() { return *reinterpret_cast<std::string *>(value.s); }
+  const std::string &str() const {
+    return *reinterpret_cast<const std::string *>(value.s);
   }
 };
 
@@ -286,9 +730,61 @@ enum ArgType {
   ArgType_Flag,      // boolean switch (e.g., --verbose)
   ArgType_Single,    // expects a single value (e.g., --output file.txt)
   ArgType_Multiple,  // expects one or more values (e.g., --input a.txt b.txt)
+  ArgType_MultipleInt,    // one or more integers (e.g., --ids 1 2 -3)
+  ArgType_MultipleDouble, // one or more numbers (e.g., --weights 0.5 -1.25)
   ArgType_Positional // argument determined by position
 };
 
+// true for the argument types that take one or more values
+inline bool is_multiple_type(ArgType type) {
+  return type == ArgType_Multiple || type == ArgType_MultipleInt ||
+         type == ArgType_MultipleDouble;
+}
+
+/**
+ * read-only view of a contiguous array (e.g., the values of an
+ * ArgType_MultipleInt argument) that does not own or copy its elements.
+ */
+template <typename T> class ValueSpan {
+public:
+  ValueSpan() : m_data(nullptr), m_size(0) {}
+  ValueSpan(const T *data, size_t size) : m_data(data), m_size(size) {}
+  explicit ValueSpan(const std::vector<T> &values)
+      : m_data(values.empty() ? nullptr : &values[0]), m_size(values.size()) {}
+
+  const T *data() const { return m_data; }
+  size_t size() const { return m_size; }
+  bool empty() const { return m_size == 0; }
+  const T &operator[](size_t index) const { return m_data[index]; }
+  const T *begin() const { return m_data; }
+  const T *end() const { return m_data + m_size; }
+
+private:
+  const T *m_data;
+  size_t m_size;
+};
+
+// relation between keyword arguments checked after a parse (see
+// Command::add_exclusive_group and friends)
+enum GroupKind {
+  GroupKind_Exclusive,  // at most one of the options may be given
+  GroupKind_AtLeastOne, // at least one of the options must be given
+  GroupKind_Requires    // if trigger is given, all of the options must be
+};
+
+struct ArgGroup {
+  GroupKind kind;
+  std::string trigger;            // GroupKind_Requires only
+  std::vector<std::string> names; // canonical option names
+};
+
+/**
+ * receives each value of a streamed ArgType_Multiple positional as it is
+ * parsed (see Command::set_positional_sink). value points into the input
+ * or into parser scratch space and is only valid during the call.
+ */
+typedef void (*PositionalSink)(const lexer::StringRef &value, void *context);
+
 struct ArgumentDef {
   std::string name; // internal name to access the parsed value
   std::vector<std::string>
@@ -298,27 +794,33 @@ struct ArgumentDef {
   bool required;          // is this argument mandatory?
   ArgValue default_value; // default value if argument is not provided
   bool is_help_flag;      // internal flag to identify the help argument
+  PositionalSink sink;    // streams values instead of storing them, if set
+  void *sink_context;     // passed through to sink
+  std::vector<std::string> choices; // allowed values, if not empty
 
   // Main constructor: accepts a vector of aliases
   ArgumentDef(std::string n, const std::vector<std::string> &als, std::string h,
               ArgType t = ArgType_Flag, bool req = false,
               ArgValue def_val = ArgValue(), bool help_flag = false)
       : name(n), aliases(als), help(h), type(t), required(req),
-        default_value(def_val), is_help_flag(help_flag) {}
+        default_value(def_val), is_help_flag(help_flag), sink(nullptr),
+        sink_context(nullptr) {}
 
   // Convenience constructor: single alias
   ArgumentDef(std::string n, std::string alias, std::string h,
               ArgType t = ArgType_Flag, bool req = false,
               ArgValue def_val = ArgValue(), bool help_flag = false)
       : name(n), help(h), type(t), required(req), default_value(def_val),
-        is_help_flag(help_flag) {
+        is_help_flag(help_flag), sink(nullptr), sink_context(nullptr) {
     if (!alias.empty()) {
       aliases.push_back(alias);
     }
   }
 
   // Default constructor
-  ArgumentDef() : type(ArgType_Flag), required(false), is_help_flag(false) {}
+  ArgumentDef()
+      : type(ArgType_Flag), required(false), is_help_flag(false), sink(nullptr),
+        sink_context(nullptr) {}
 
   // get display name (e.g., "-f, --file")
   std::string get_display_name() const {
@@ -349,7 +851,7 @@ struct ArgumentDef {
     }
     if (type != ArgType_Flag && type != ArgType_Positional) {
       display += " <value>";
-      if (type == ArgType_Multiple) {
+      if (is_multiple_type(type)) {
         display += "...";
       }
     }
@@ -357,79 +859,525 @@ struct ArgumentDef {
   }
 };
 
-// represents a command or subcommand with its arguments
-class Command : public enable_shared_command {
+/**
+ * token cursors feed Command::parse_cursor(). a cursor exposes size() and
+ * operator[](index) returning the token at that index. VectorCursor reads an
+ * existing token vector; ArgvCursor classifies argv elements on demand so
+ * the argv path needs no intermediate token container.
+ */
+class VectorCursor {
 public:
-  typedef int (*CommandHandler)(const ParseResult &result);
+  // source, if given, is the input the tokens were lexed from; raw() then
+  // returns each token's exact text via its span
+  explicit VectorCursor(const std::vector<lexer::Token> &tokens,
+                        const char *source = nullptr)
+      : m_tokens(tokens), m_source(source) {}
+
+  size_t size() const { return m_tokens.size(); }
+  bool has(size_t index) const { return index < m_tokens.size(); }
+  const lexer::Token &operator[](size_t index) { return m_tokens[index]; }
+
+  // original text of a token. without a source, flags and identifiers
+  // still point into the input; other literals have no text
+  lexer::StringRef raw(size_t index) const {
+    const lexer::Token &token = m_tokens[index];
+    lexer::StringRef text;
+    if (m_source) {
+      text.start = m_source + token.get_span().start;
+      text.length = token.get_span().end - token.get_span().start;
+      return text;
+    }
+    text.start = token.get_string_ref_start();
+    text.length = text.start ? token.get_string_ref_length() : 0;
+    size_t dashes = token.get_kind() == lexer::TokFlagLong    ? 2
+                    : token.get_kind() == lexer::TokFlagShort ? 1
+                                                              : 0;
+    if (text.start) {
+      text.start -= dashes;
+      text.length += dashes;
+    }
+    return text;
+  }
 
-  Command(std::string name, std::string help)
-      : m_name(name), m_help(help), m_handler(nullptr) {
-    ensure_help_argument();
+private:
+  const std::vector<lexer::Token> &m_tokens;
+  const char *m_source;
+};
+
+class ArgvCursor {
+public:
+  // tokens for argv[1..argc-1]; argv must outlive the cursor
+  ArgvCursor(int argc, char *argv[])
+      : m_argv(argv), m_size(argc > 1 ? static_cast<size_t>(argc - 1) : 0),
+        m_scan_index(0), m_scan_pos(0) {
+    m_cache[0].index = SlotTable::npos;
+    m_cache[1].index = SlotTable::npos;
   }
 
-  // destructor to clean up subcommand pointers
-  ~Command() { m_commands.clear(); }
+  size_t size() const { return m_size; }
+  bool has(size_t index) const { return index < m_size; }
 
-  // add a keyword/option argument (e.g., --file, -f)
-  // New add_keyword_arg: accepts a vector of aliases for maximum flexibility
-  Command &add_keyword_arg(std::string name,
-                           const std::vector<std::string> &aliases,
-                           std::string help, ArgType type = ArgType_Flag,
-                           bool required = false,
-                           ArgValue default_value = ArgValue()) {
-    // prevent adding another argument named "help" or starting with "no_"
-    if (name == "help") {
-      throw std::invalid_argument(
-          "argument name 'help' is reserved for the automatic help flag.");
-    }
-    if (name.rfind("no_", 0) == 0) {
-      throw std::invalid_argument(
-          "argument name cannot start with 'no_'. this prefix is reserved for "
-          "automatic negation flags.");
-    }
-    for (size_t i = 0; i < aliases.size(); ++i) {
-      if (!aliases[i].empty() && aliases[i].find("--no-") == 0) {
-        throw std::invalid_argument(
-            "alias cannot start with '--no-'. this prefix is reserved for "
-            "automatic negation flags.");
+  // the whole argv element (NUL-terminated)
+  lexer::StringRef raw(size_t index) const {
+    lexer::StringRef text;
+    text.start = m_argv[index + 1];
+    text.length = std::strlen(text.start);
+    return text;
+  }
+
+  // token for argv[index + 1]. the parser reads the current token and looks
+  // one ahead, so two cached entries (by index parity) keep both alive: a
+  // returned reference stays valid until an index of the same parity is read.
+  const lexer::Token &operator[](size_t index) {
+    Entry &entry = m_cache[index & 1];
+    if (entry.index != index) {
+      if (index < m_scan_index) {
+        // rare backwards access: recompute spans from the start
+        m_scan_index = 0;
+        m_scan_pos = 0;
+      }
+      while (m_scan_index < index) {
+        m_scan_pos += std::strlen(m_argv[m_scan_index + 1]) + 1;
+        m_scan_index++;
       }
+      const char *arg = m_argv[index + 1];
+      size_t len = std::strlen(arg);
+      entry.token = make_token(arg, len, m_scan_pos);
+      entry.index = index;
+      m_scan_index = index + 1;
+      m_scan_pos += len + 1;
     }
+    return entry.token;
+  }
 
-    // if it's a flag and the default value is still the initial avk_none,
-    // set the actual default to false. otherwise, use the provided default.
-    ArgValue final_default_value = default_value;
-    if (type == ArgType_Flag && default_value.is_none()) {
-      final_default_value = ArgValue(false);
+  /**
+   * classifies one argv element by CLI rules: long flag, short flag(s),
+   * quoted literal (quotes stripped) or identifier. the token points into
+   * arg; pos is the element's offset in the space-joined command line.
+   */
+  static lexer::Token make_token(const char *arg, size_t len, size_t pos) {
+    lexer::Span span(pos, pos + len);
+    if (len > 2 && arg[0] == '-' && arg[1] == '-') {
+      // Long flag: --flag
+      return lexer::Token::make_long_flag(arg + 2, len - 2, span);
+    } else if (len > 1 && arg[0] == '-') {
+      // Short flag: -f or -abc
+      return lexer::Token::make_short_flag(arg + 1, len - 1, span);
+    } else if (len >= 2 && ((arg[0] == '"' && arg[len - 1] == '"') ||
+                            (arg[0] == '\'' && arg[len - 1] == '\''))) {
+      // Quoted string literal (remove quotes)
+      return lexer::Token::make_str_lit(arg + 1, len - 2, span);
     }
+    // All other arguments: treat as identifier (positional or value)
+    return lexer::Token::make_id(arg, len, span);
+  }
 
-    // ensure the new keyword argument name is unique
-    std::vector<ArgumentDef>::iterator it = m_kw_args.begin();
-    for (; it != m_kw_args.end(); ++it) {
-      if (it->name == name)
-        break;
-    }
-    if (it != m_kw_args.end()) {
-      throw std::invalid_argument("argument name '" + name +
-                                  "' already exists.");
+private:
+  struct Entry {
+    size_t index;
+    lexer::Token token;
+  };
+
+  char **m_argv;
+  size_t m_size;
+  size_t m_scan_index; // next element whose offset is m_scan_pos
+  size_t m_scan_pos;
+  Entry m_cache[2];
+};
+
+/**
+ * owns the response files opened while parsing. they stay mapped until
+ * clear() so that tokens (and lazy values) pointing into them remain valid
+ * after the parse.
+ */
+class ResponseFiles {
+public:
+  ResponseFiles() {}
+  ~ResponseFiles() { clear(); }
+
+  // maps path; nullptr if it cannot be opened
+  const lexer::MappedFile *open(const std::string &path) {
+    lexer::MappedFile *file = new lexer::MappedFile();
+    if (!file->open(path)) {
+      delete file;
+      return nullptr;
     }
-    // ensure aliases are unique across all args (including potential
-    // auto-generated ones)
-    for (std::vector<ArgumentDef>::const_iterator kwarg = m_kw_args.begin();
-         kwarg != m_kw_args.end(); ++kwarg) {
-      const ArgumentDef &existing_arg = *kwarg;
-      for (size_t i = 0; i < aliases.size(); ++i) {
-        for (size_t j = 0; j < existing_arg.aliases.size(); ++j) {
-          if (!aliases[i].empty() && aliases[i] == existing_arg.aliases[j]) {
-            throw std::invalid_argument("alias '" + aliases[i] +
-                                        "' already exists.");
-          }
-        }
-      }
+    m_files.push_back(file);
+    return file;
+  }
+
+  void clear() {
+    for (size_t i = 0; i < m_files.size(); ++i) {
+      delete m_files[i];
     }
+    m_files.clear();
+  }
 
-    // add the primary argument definition
-    m_kw_args.push_back(
-        ArgumentDef(name, aliases, help, type, required, final_default_value));
+private:
+  // private copy constructor and assignment operator to prevent copying
+  ResponseFiles(const ResponseFiles &);
+  ResponseFiles &operator=(const ResponseFiles &);
+
+  std::vector<lexer::MappedFile *> m_files;
+};
+
+/**
+ * argv cursor that expands "@file" arguments (response files) as the parser
+ * reaches them, so no expanded argv is ever built. a file is mapped and
+ * split on whitespace; a double-quoted word is one string literal whose
+ * escapes follow the lexer's string rules, and every other word is
+ * classified like an argv element (see ArgvCursor::make_token). words of
+ * the form "@path" nest; relative paths are opened from the working
+ * directory. tokens point into argv or into the mapped files.
+ * throws std::runtime_error for unreadable, cyclic or unterminated files.
+ * only moves forward: like ArgvCursor it keeps the last two tokens.
+ */
+class ResponseFileCursor {
+public:
+  static const size_t max_depth = 32; // nested files open at once
+
+  ResponseFileCursor(int argc, char *argv[], ResponseFiles &files)
+      : m_argv(argv), m_argc(argc), m_next_arg(1), m_produced(0), m_pos(0),
+        m_done(false), m_files(files) {
+    m_cache[0].index = SlotTable::npos;
+    m_cache[1].index = SlotTable::npos;
+  }
+
+  bool has(size_t index) {
+    fill(index);
+    return index < m_produced;
+  }
+
+  const lexer::Token &operator[](size_t index) {
+    fill(index);
+    const Entry &entry = m_cache[index & 1];
+    if (index >= m_produced || entry.index != index) {
+      throw std::out_of_range("response file cursor cannot revisit token");
+    }
+    return entry.token;
+  }
+
+  // the argv element or response file word (quotes included) of a token;
+  // only argv elements are NUL-terminated
+  lexer::StringRef raw(size_t index) {
+    fill(index);
+    const Entry &entry = m_cache[index & 1];
+    if (index >= m_produced || entry.index != index) {
+      throw std::out_of_range("response file cursor cannot revisit token");
+    }
+    return entry.raw;
+  }
+
+private:
+  struct Entry {
+    size_t index;
+    lexer::Token token;
+    lexer::StringRef raw;
+  };
+
+  struct Frame {
+    std::string path;
+    const char *data;
+    size_t size;
+    size_t pos;
+  };
+
+  static bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' ||
+           c == '\v';
+  }
+
+  void fill(size_t index) {
+    while (!m_done && m_produced <= index) {
+      produce_next();
+    }
+  }
+
+  void emit(const lexer::Token &token, const char *word, size_t len) {
+    Entry &entry = m_cache[m_produced & 1];
+    entry.token = token;
+    entry.raw.start = word;
+    entry.raw.length = len;
+    entry.index = m_produced;
+    ++m_produced;
+    m_pos += len + 1;
+  }
+
+  // reads the next word from the innermost open file or from argv
+  void produce_next() {
+    while (true) {
+      if (m_stack.empty()) {
+        if (m_next_arg >= m_argc) {
+          m_done = true;
+          return;
+        }
+        const char *arg = m_argv[m_next_arg++];
+        size_t len = std::strlen(arg);
+        if (!expand(arg, len)) {
+          emit(ArgvCursor::make_token(arg, len, m_pos), arg, len);
+          return;
+        }
+        continue;
+      }
+
+      Frame &frame = m_stack.back();
+      while (frame.pos < frame.size && is_space(frame.data[frame.pos])) {
+        ++frame.pos;
+      }
+      if (frame.pos == frame.size) {
+        m_stack.pop_back(); // the mapping lives on in m_files
+        continue;
+      }
+
+      const char *word = frame.data + frame.pos;
+      size_t end = frame.pos;
+      if (*word == '"') {
+        for (++end; end < frame.size && frame.data[end] != '"'; ++end) {
+          if (frame.data[end] == '\\' && end + 1 < frame.size) {
+            ++end;
+          }
+        }
+        if (end == frame.size) {
+          throw std::runtime_error("unclosed string in response file: " +
+                                   frame.path);
+        }
+        size_t len = end + 1 - frame.pos;
+        frame.pos = end + 1;
+        emit(lexer::Token::make_str_lit(word + 1, len - 2,
+                                        lexer::Span(m_pos, m_pos + len)),
+             word, len);
+        return;
+      }
+      while (end < frame.size && !is_space(frame.data[end])) {
+        ++end;
+      }
+      size_t len = end - frame.pos;
+      frame.pos = end;
+      if (!expand(word, len)) {
+        emit(ArgvCursor::make_token(word, len, m_pos), word, len);
+        return;
+      }
+    }
+  }
+
+  // opens "@path" as a nested response file; false for any other word
+  bool expand(const char *word, size_t len) {
+    if (len < 2 || word[0] != '@') {
+      return false;
+    }
+    std::string path(word + 1, len - 1);
+    for (size_t i = 0; i < m_stack.size(); ++i) {
+      if (m_stack[i].path == path) {
+        throw std::runtime_error("response file includes itself: " + path);
+      }
+    }
+    if (m_stack.size() >= max_depth) {
+      throw std::runtime_error("response files nested too deeply: " + path);
+    }
+    const lexer::MappedFile *file = m_files.open(path);
+    if (!file) {
+      throw std::runtime_error("could not open response file: " + path);
+    }
+    Frame frame;
+    frame.path = path;
+    frame.data = file->get_data();
+    frame.size = file->get_size();
+    frame.pos = 0;
+    m_stack.push_back(frame);
+    return true;
+  }
+
+  char **m_argv;
+  int m_argc;
+  int m_next_arg;     // next argv element to read once m_stack is empty
+  size_t m_produced;  // tokens produced so far
+  size_t m_pos;       // offset in the (virtual) space-joined command line
+  bool m_done;
+  ResponseFiles &m_files;
+  std::vector<Frame> m_stack; // open response files, innermost last
+  Entry m_cache[2];
+};
+
+/**
+ * maps a C++ value type to how typed arguments (ArgHandle<T>) are defined
+ * and read. only bool, long long, double, std::string and std::vector of
+ * std::string, long long or double are supported.
+ */
+template <typename T> struct ArgTraits {
+#if defined(PARSER_HAS_STATIC_ASSERT)
+  static_assert(sizeof(T) == 0, "ArgHandle<T> supports bool, long long, "
+                                "double, std::string and std::vector of "
+                                "std::string, long long or double only");
+#else
+private:
+  ArgTraits(); // unsupported value type
+#endif
+};
+
+template <> struct ArgTraits<bool> {
+  static const ArgType keyword_type = ArgType_Flag;
+  static const ArgType positional_type = ArgType_Single;
+  static const bool *get(const ArgValue &value) { return value.get_bool(); }
+};
+
+template <> struct ArgTraits<long long> {
+  static const ArgType keyword_type = ArgType_Single;
+  static const ArgType positional_type = ArgType_Single;
+  static const long long *get(const ArgValue &value) {
+    return value.get_int();
+  }
+};
+
+template <> struct ArgTraits<double> {
+  static const ArgType keyword_type = ArgType_Single;
+  static const ArgType positional_type = ArgType_Single;
+  static const double *get(const ArgValue &value) {
+    return value.get_double();
+  }
+};
+
+template <> struct ArgTraits<std::string> {
+  static const ArgType keyword_type = ArgType_Single;
+  static const ArgType positional_type = ArgType_Single;
+  static const std::string *get(const ArgValue &value) {
+    return value.get_string();
+  }
+};
+
+template <> struct ArgTraits<std::vector<std::string> > {
+  static const ArgType keyword_type = ArgType_Multiple;
+  static const ArgType positional_type = ArgType_Multiple;
+  static const std::vector<std::string> *get(const ArgValue &value) {
+    return value.get_string_vector();
+  }
+};
+
+template <> struct ArgTraits<std::vector<long long> > {
+  static const ArgType keyword_type = ArgType_MultipleInt;
+  static const ArgType positional_type = ArgType_MultipleInt;
+  static const std::vector<long long> *get(const ArgValue &value) {
+    return value.get_int_vector();
+  }
+};
+
+template <> struct ArgTraits<std::vector<double> > {
+  static const ArgType keyword_type = ArgType_MultipleDouble;
+  static const ArgType positional_type = ArgType_MultipleDouble;
+  static const std::vector<double> *get(const ArgValue &value) {
+    return value.get_double_vector();
+  }
+};
+
+/**
+ * typed reference to an argument, returned by Command::add_typed_keyword_arg
+ * and add_typed_positional_arg. reads its value from a ParseResult by slot,
+ * so there is no name lookup and no way to misspell the argument.
+ */
+template <typename T> class ArgHandle {
+public:
+  ArgHandle()
+      : m_command(nullptr), m_slot(SlotTable::npos), m_positional(false) {}
+  ArgHandle(const Command *command, size_t slot, bool positional)
+      : m_command(command), m_slot(slot), m_positional(positional) {}
+
+  bool is_valid() const { return m_command != nullptr; }
+  size_t get_slot() const { return m_slot; }
+  bool is_positional() const { return m_positional; }
+  const Command *get_command() const { return m_command; }
+
+  // pointer to the parsed value; nullptr if missing, of the wrong type, or
+  // if the result was produced by a different command
+  const T *get(const ParseResult &result) const;
+
+  // the parsed value, or the argument's default (T() if it has none)
+  T find(const ParseResult &result) const;
+
+  // true if the argument was given on the command line
+  bool was_given(const ParseResult &result) const;
+
+private:
+  const Command *m_command;
+  size_t m_slot;
+  bool m_positional;
+};
+
+// represents a command or subcommand with its arguments
+class Command : public enable_shared_command {
+public:
+  typedef int (*CommandHandler)(const ParseResult &result);
+
+  Command(std::string name, std::string help)
+      : m_name(name), m_help(help), m_allow_abbrev(false),
+        m_index_stale(true), m_frozen(false), m_indexed_alias_count(0),
+        m_help_slot(SlotTable::npos), m_handler(nullptr) {
+    ensure_help_argument();
+  }
+
+  // destructor to clean up subcommand pointers
+  ~Command() { m_commands.clear(); }
+
+  // add a keyword/option argument (e.g., --file, -f)
+  // New add_keyword_arg: accepts a vector of aliases for maximum flexibility
+  Command &add_keyword_arg(std::string name,
+                           const std::vector<std::string> &aliases,
+                           std::string help, ArgType type = ArgType_Flag,
+                           bool required = false,
+                           ArgValue default_value = ArgValue()) {
+    // prevent adding another argument named "help" or starting with "no_"
+    if (name == "help") {
+      throw std::invalid_argument(
+          "argument name 'help' is reserved for the automatic help flag.");
+    }
+    if (name.rfind("no_", 0) == 0) {
+      throw std::invalid_argument(
+          "argument name cannot start with 'no_'. this prefix is reserved for "
+          "automatic negation flags.");
+    }
+    for (size_t i = 0; i < aliases.size(); ++i) {
+      if (!aliases[i].empty() && aliases[i].find("--no-") == 0) {
+        throw std::invalid_argument(
+            "alias cannot start with '--no-'. this prefix is reserved for "
+            "automatic negation flags.");
+      }
+    }
+
+    // if it's a flag and the default value is still the initial avk_none,
+    // set the actual default to false. otherwise, use the provided default.
+    ArgValue final_default_value = default_value;
+    if (type == ArgType_Flag && default_value.is_none()) {
+      final_default_value = ArgValue(false);
+    }
+
+    // ensure the new keyword argument name is unique
+    std::vector<ArgumentDef>::iterator it = m_kw_args.begin();
+    for (; it != m_kw_args.end(); ++it) {
+      if (it->name == name)
+        break;
+    }
+    if (it != m_kw_args.end()) {
+      throw std::invalid_argument("argument name '" + name +
+                                  "' already exists.");
+    }
+    // ensure aliases are unique across all args (including potential
+    // auto-generated ones)
+    for (std::vector<ArgumentDef>::const_iterator kwarg = m_kw_args.begin();
+         kwarg != m_kw_args.end(); ++kwarg) {
+      const ArgumentDef &existing_arg = *kwarg;
+      for (size_t i = 0; i < aliases.size(); ++i) {
+        for (size_t j = 0; j < existing_arg.aliases.size(); ++j) {
+          if (!aliases[i].empty() && aliases[i] == existing_arg.aliases[j]) {
+            throw std::invalid_argument("alias '" + aliases[i] +
+                                        "' already exists.");
+          }
+        }
+      }
+    }
+
+    invalidate_index();
+
+    // add the primary argument definition
+    m_kw_args.push_back(
+        ArgumentDef(name, aliases, help, type, required, final_default_value));
 
     // check if we need to add an automatic --no-<flag>
     const bool *default_bool = final_default_value.get_bool();
@@ -473,6 +1421,50 @@ public:
     return *this;
   }
 
+  // add a keyword argument whose type follows from T (bool -> flag,
+  // std::vector<std::string> -> multiple, otherwise single) and return a
+  // typed handle to read it back
+  template <typename T>
+  ArgHandle<T> add_typed_keyword_arg(const std::string &name,
+                                     const std::vector<std::string> &aliases,
+                                     const std::string &help,
+                                     bool required = false) {
+    size_t slot = m_kw_args.size();
+    add_keyword_arg(name, aliases, help, ArgTraits<T>::keyword_type, required);
+    return ArgHandle<T>(this, slot, false);
+  }
+
+  template <typename T>
+  ArgHandle<T> add_typed_keyword_arg(const std::string &name,
+                                     const std::vector<std::string> &aliases,
+                                     const std::string &help, bool required,
+                                     const T &default_value) {
+    size_t slot = m_kw_args.size();
+    add_keyword_arg(name, aliases, help, ArgTraits<T>::keyword_type, required,
+                    ArgValue(default_value));
+    return ArgHandle<T>(this, slot, false);
+  }
+
+  // add a positional argument typed by T and return a handle to read it back
+  template <typename T>
+  ArgHandle<T> add_typed_positional_arg(const std::string &name,
+                                        const std::string &help,
+                                        bool required = true) {
+    size_t slot = m_pos_args.size();
+    add_positional_arg(name, help, ArgTraits<T>::positional_type, required);
+    return ArgHandle<T>(this, slot, true);
+  }
+
+  template <typename T>
+  ArgHandle<T> add_typed_positional_arg(const std::string &name,
+                                        const std::string &help,
+                                        bool required, const T &default_value) {
+    size_t slot = m_pos_args.size();
+    add_positional_arg(name, help, ArgTraits<T>::positional_type, required,
+                       ArgValue(default_value));
+    return ArgHandle<T>(this, slot, true);
+  }
+
   // add a positional argument (defined by order)
   Command &add_positional_arg(std::string name, std::string help,
                               ArgType type = ArgType_Single,
@@ -492,6 +1484,7 @@ public:
       throw std::invalid_argument("argument '" + name + "' already exists.");
     }
 
+    invalidate_index();
     std::vector<std::string> empty_aliases;
     m_pos_args.push_back(ArgumentDef(name, empty_aliases, help,
                                      ArgType_Positional, required,
@@ -500,6 +1493,94 @@ public:
     return *this;
   }
 
+  /**
+   * constraints between keyword arguments, named by their canonical names
+   * (which must already be defined). each group is compiled into a bitmask
+   * over keyword slots with the other lookup indexes, so checking them all
+   * after a parse takes a few word-wide operations.
+   */
+
+  // at most one of names may be given
+  Command &add_exclusive_group(const std::vector<std::string> &names) {
+    return add_group(GroupKind_Exclusive, std::string(), names);
+  }
+
+  // at least one of names must be given
+  Command &add_at_least_one_group(const std::vector<std::string> &names) {
+    return add_group(GroupKind_AtLeastOne, std::string(), names);
+  }
+
+  // if name is given, every one of required_names must be given too
+  Command &add_requires(const std::string &name,
+                        const std::vector<std::string> &required_names) {
+    return add_group(GroupKind_Requires, name, required_names);
+  }
+
+  const std::vector<ArgGroup> &get_groups() const { return m_groups; }
+
+  /**
+   * restricts a single-valued argument (keyword or positional) to a fixed
+   * set of strings. the set is compiled into a perfect hash with the other
+   * lookup indexes, and parsing records the matching ordinal (see
+   * ParseResult::get_kw_choice/get_pos_choice); the stored value borrows
+   * the choice string instead of copying it.
+   */
+  Command &set_choices(const std::string &name,
+                       const std::vector<std::string> &choices) {
+    ArgumentDef *arg = nullptr;
+    for (size_t i = 0; i < m_kw_args.size() && !arg; ++i) {
+      if (m_kw_args[i].name == name) {
+        arg = &m_kw_args[i];
+      }
+    }
+    for (size_t i = 0; i < m_pos_args.size() && !arg; ++i) {
+      if (m_pos_args[i].name == name) {
+        arg = &m_pos_args[i];
+      }
+    }
+    if (!arg) {
+      throw std::invalid_argument("unknown argument '" + name + "'.");
+    }
+    if (arg->type != ArgType_Single) {
+      throw std::invalid_argument("choices require a single-valued argument: '" +
+                                  name + "'.");
+    }
+    for (size_t i = 0; i < choices.size(); ++i) {
+      for (size_t j = 0; j < i; ++j) {
+        if (choices[i] == choices[j]) {
+          throw std::invalid_argument("duplicate choice '" + choices[i] +
+                                      "' for argument '" + name + "'.");
+        }
+      }
+    }
+    invalidate_index();
+    arg->choices = choices;
+    return *this;
+  }
+
+  /**
+   * streams an ArgType_Multiple positional: each value is handed to sink as
+   * it is parsed and nothing is stored in the ParseResult (has_pos_arg()
+   * still reports whether any value was given). pass nullptr to go back to
+   * collecting the values.
+   */
+  Command &set_positional_sink(const std::string &name, PositionalSink sink,
+                               void *context = nullptr) {
+    check_mutable();
+    for (size_t i = 0; i < m_pos_args.size(); ++i) {
+      if (m_pos_args[i].name == name) {
+        if (m_pos_args[i].type != ArgType_Multiple) {
+          throw std::invalid_argument("positional argument '" + name +
+                                      "' does not take multiple values.");
+        }
+        m_pos_args[i].sink = sink;
+        m_pos_args[i].sink_context = sink ? context : nullptr;
+        return *this;
+      }
+    }
+    throw std::invalid_argument("unknown positional argument '" + name + "'.");
+  }
+
   // add a command under this command (making this command act as a group)
   Command &add_command(command_ptr sub) {
     if (!sub)
@@ -542,6 +1623,7 @@ public:
       }
     }
 
+    invalidate_index();
     m_commands[sub_name] = sub;
     return *this;
   }
@@ -554,6 +1636,7 @@ public:
     }
     // could add checks here to ensure alias doesn't conflict with other sibling
     // commands/aliases if added to a parent
+    invalidate_index();
     m_aliases.push_back(alias);
     return *this;
   }
@@ -564,6 +1647,18 @@ public:
     return *this;
   }
 
+  /**
+   * accept unambiguous prefixes of long options ("--verb" for "--verbose"),
+   * like getopt_long. an exact name always wins; a prefix shared by several
+   * options is an error listing them. applies to this command only.
+   */
+  Command &set_allow_abbrev(bool allow) {
+    check_mutable();
+    m_allow_abbrev = allow;
+    return *this;
+  }
+  bool get_allow_abbrev() const { return m_allow_abbrev; }
+
   const std::string &get_name() const { return m_name; }
   const std::string &get_help() const { return m_help; }
   const std::map<std::string, command_ptr> &get_commands() const {
@@ -576,10 +1671,97 @@ public:
   const std::vector<std::string> &get_aliases() const { return m_aliases; }
   CommandHandler get_handler() const { return m_handler; }
 
+  // slot (index into get_keyword_args()) of the keyword argument with the
+  // given canonical name, or SlotTable::npos
+  size_t get_keyword_slot(const std::string &name) const {
+    if (m_index_stale) {
+      return find_slot_by_name(m_kw_args, name);
+    }
+    return m_kw_name_index.find(name);
+  }
+
+  // slot (index into get_positional_args()) of the positional argument with
+  // the given name, or SlotTable::npos
+  size_t get_positional_slot(const std::string &name) const {
+    if (m_index_stale) {
+      return find_slot_by_name(m_pos_args, name);
+    }
+    return m_pos_name_index.find(name);
+  }
+
   ParseResult parse(const std::vector<lexer::Token> &tokens,
                     size_t &current_token_index,
                     const std::string &command_path_prefix) const;
 
+  /**
+   * dispatch-only walk: finds the deepest subcommand named by the tokens
+   * from index on, without converting values, applying defaults, checking
+   * constraints or printing help. flags are stepped over using the index
+   * of which options take values; positionals are stepped over as parse
+   * would consume them. on return index is just past the returned
+   * command's name (unchanged if this command is returned). does not
+   * allocate; the lookup indexes must be built (see freeze).
+   */
+  const Command *resolve_command(const std::vector<lexer::Token> &tokens,
+                                 size_t &index) const {
+    VectorCursor cursor(tokens);
+    return resolve_cursor(cursor, index);
+  }
+
+  template <typename Cursor>
+  const Command *resolve_cursor(Cursor &cursor, size_t &index) const;
+
+  // parse over any token cursor (see VectorCursor, ArgvCursor)
+  template <typename Cursor>
+  ParseResult parse_cursor(Cursor &cursor, size_t &current_token_index,
+                           const std::string &command_path_prefix) const;
+
+  // like parse_cursor, but fills the caller's result. its strings, slot
+  // values and lists keep their capacity, so once warmed up, repeated
+  // parses into one result do not allocate for flags, numbers, choices,
+  // number lists, strings no longer than the slot's string has been, and
+  // string list elements up to the std::string small-buffer size.
+  template <typename Cursor>
+  void parse_cursor_into(Cursor &cursor, size_t &current_token_index,
+                         const std::string &command_path_prefix,
+                         ParseResult &result) const;
+
+  /**
+   * builds the lookup indexes of this command and all of its subcommands
+   * and makes their schemas read-only: adding arguments, aliases, choices,
+   * groups or subcommands afterwards throws std::logic_error. parsing an
+   * unfrozen command rebuilds its indexes on first use after a change
+   * (under a lock); a frozen one is parsed without locking.
+   */
+  Command &freeze() {
+    refresh_index();
+    if (!m_ambiguous_alias.empty()) {
+      throw std::invalid_argument("subcommand alias '" + m_ambiguous_alias +
+                                  "' matches multiple subcommands.");
+    }
+    for (std::map<std::string, command_ptr>::const_iterator it =
+             m_commands.begin();
+         it != m_commands.end(); ++it) {
+      it->second->freeze();
+    }
+    m_frozen = true;
+    return *this;
+  }
+  bool is_frozen() const { return m_frozen; }
+
+  /**
+   * rebuilds the lookup indexes of this command and its subcommands that are
+   * stale after a schema change. a no-op for frozen commands.
+   */
+  void refresh_index() {
+    ensure_index();
+    for (std::map<std::string, command_ptr>::const_iterator it =
+             m_commands.begin();
+         it != m_commands.end(); ++it) {
+      it->second->refresh_index();
+    }
+  }
+
   // generate help text for this command and its subcommands
   void generate_help(std::ostream &os,
                      const std::string &command_path_prefix) const {
@@ -642,7 +1824,7 @@ public:
       positional_usage += (pos_arg.required ? "<" : "[");
       positional_usage += pos_arg.name;
       positional_usage += (pos_arg.required ? ">" : "]");
-      if (pos_arg.type == ArgType_Multiple)
+      if (is_multiple_type(pos_arg.type))
         positional_usage += "...";
     }
 
@@ -667,6 +1849,7 @@ public:
         const ArgumentDef &arg = *it;
         os << "  " << std::left << std::setw(max_pos_arg_width) << arg.name
            << arg.help;
+        print_choices(os, arg);
         // check default value is not none
         if (!arg.default_value.is_none()) {
           os << " (default: ";
@@ -688,6 +1871,7 @@ public:
         const ArgumentDef &arg = *it;
         os << "  " << std::left << std::setw(max_kw_arg_width)
            << arg.get_display_name() << arg.help;
+        print_choices(os, arg);
         if (!arg.default_value.is_none()) {
           // only show non-default bools (true) or non-bool defaults
           const bool *b_val = arg.default_value.get_bool();
@@ -732,6 +1916,8 @@ public:
   }
 
 private:
+  friend class ParseResult; // converts deferred values (see set_lazy_values)
+
   // private copy constructor and assignment operator to prevent copying
   Command(const Command &);
   Command &operator=(const Command &);
@@ -742,60 +1928,673 @@ private:
   std::vector<ArgumentDef> m_pos_args;
   std::map<std::string, command_ptr> m_commands;
   std::vector<std::string> m_aliases;
+  bool m_allow_abbrev; // long option prefixes resolve (set_allow_abbrev)
+  std::vector<ArgGroup> m_groups;
+
+  // an ArgGroup as keyword slots (trigger is npos unless GroupKind_Requires)
+  struct CompiledGroup {
+    size_t trigger;
+    SlotSet members;
+  };
+
+  // long flag name and its keyword slot, ordered by name for prefix search
+  struct LongName {
+    std::string name;
+    size_t slot;
+    bool operator<(const LongName &other) const { return name < other.name; }
+    // orders a name before a (data, length) key without copying the key
+    bool operator<(const lexer::StringRef &key) const {
+      return name.compare(0, std::string::npos, key.start, key.length) < 0;
+    }
+  };
+
+  // lookup indexes built from the schema. the const parse paths build
+  // them on first use after a schema change (see ensure_index), hence
+  // mutable; freeze() builds them once and for all
+  mutable bool m_index_stale; // the schema changed since build_index
+  bool m_frozen;              // freeze() was called; the schema is read-only
+#if defined(LEXER_HAS_THREADS)
+  mutable std::mutex m_index_mutex; // serializes ensure_index when unfrozen
+#endif
+  // subcommand aliases seen by build_index; aliases are only ever added, so
+  // a different total means a child gained an alias
+  mutable size_t m_indexed_alias_count;
+  mutable SlotTable m_short_index; // short flag name -> keyword slot
+  mutable SlotTable m_long_index;  // long flag name -> keyword slot
+  mutable std::vector<LongName> m_long_sorted; // keys of m_long_index, sorted
+  mutable SlotTable m_kw_name_index;  // canonical name -> keyword slot
+  mutable SlotTable m_pos_name_index; // name -> positional slot
+  // single-character short flag byte -> keyword slot + 1 (0 if none);
+  // 256 entries, or empty if the command has no such flags
+  mutable std::vector<unsigned int> m_short_char_slots;
+  mutable SlotSet m_flag_slots;     // keyword slots of boolean flags
+  mutable SlotSet m_required_slots; // required keyword slots (not help)
+  mutable std::vector<CompiledGroup> m_compiled_groups; // one per m_groups
+  // compiled choices per slot (empty tables for unrestricted arguments)
+  mutable std::vector<ChoiceTable> m_kw_choices;
+  mutable std::vector<ChoiceTable> m_pos_choices;
+  mutable size_t m_help_slot; // keyword slot of the help flag
+  // subcommand name or alias -> index into m_command_list (names win over
+  // aliases; an alias claimed by two children maps to ambiguous_command)
+  mutable SlotTable m_command_index;
+  mutable std::vector<command_ptr> m_command_list;
+  mutable std::string m_ambiguous_alias; // first ambiguous alias, if any
+
+  static const size_t ambiguous_command = SlotTable::npos - 1;
 
 public:
   CommandHandler m_handler;
 
 private:
   // helper to check if the token at the given index is a flag/option token
-  bool is_flag_token(const std::vector<lexer::Token> &tokens,
-                     size_t index) const {
-    if (index >= tokens.size())
+  template <typename Cursor>
+  bool is_flag_token(Cursor &tokens, size_t index) const {
+    if (!tokens.has(index))
       return false;
     lexer::TokenKind kind = tokens[index].get_kind();
     return kind == lexer::TokFlagShort || kind == lexer::TokFlagLong;
   }
 
-  // find keyword argument definition by flag name (use iterator loop)
-  const ArgumentDef *find_keyword_arg(
-      const std::string &flag_name_value, // name part only (e.g., "f", "force")
-      bool is_short_flag_kind) const {
-    for (std::vector<ArgumentDef>::const_iterator it = m_kw_args.begin();
-         it != m_kw_args.end(); ++it) {
-      const ArgumentDef &arg = *it;
-      if (arg.name == flag_name_value) {
-        return &arg;
-      }
-      for (size_t i = 0; i < arg.aliases.size(); ++i) {
-        const std::string &alias = arg.aliases[i];
-        if (is_short_flag_kind) {
-          // match "-f" for short flag "f"
-          if (alias.length() == 2 && alias[0] == '-' &&
-              alias.substr(1) == flag_name_value) {
-            return &arg;
-          }
-        } else {
-          // match "--force" for long flag "force"
-          if (alias.length() > 2 && alias.substr(0, 2) == "--" &&
-              alias.substr(2) == flag_name_value) {
-            return &arg;
-          }
-        }
-      }
+  // schema changes are refused once the command is frozen
+  void check_mutable() const {
+    if (m_frozen) {
+      throw std::logic_error("command '" + m_name +
+                             "' is frozen; its schema cannot change.");
     }
-    return nullptr;
   }
 
-  // helper to parse a single token into an ArgValue based on expected type
-  // returns ArgValue (which manages memory for string/vector)
-  ArgValue parse_token_value(const lexer::Token &token,
-                             ArgType expected_type) const {
-    lexer::TokenKind kind = token.get_kind();
+  // mark this command's lookup indexes as stale after a schema change
+  void invalidate_index() {
+    check_mutable();
+    m_index_stale = true;
+  }
 
-    // allow broader range of tokens to be interpreted as strings if expected
-    bool expect_string =
-        (expected_type == ArgType_Single || expected_type == ArgType_Multiple ||
-         expected_type == ArgType_Positional);
+  size_t subcommand_alias_count() const {
+    size_t count = 0;
+    for (std::map<std::string, command_ptr>::const_iterator it =
+             m_commands.begin();
+         it != m_commands.end(); ++it) {
+      count += it->second->get_aliases().size();
+    }
+    return count;
+  }
+
+  bool index_stale() const {
+    return m_index_stale || subcommand_alias_count() != m_indexed_alias_count;
+  }
+
+  // makes the lookup indexes current before a parse path reads them. a
+  // frozen command's indexes never change, so no lock is taken for it
+  void ensure_index() const {
+    if (m_frozen) {
+      return;
+    }
+#if defined(LEXER_HAS_THREADS)
+    std::lock_guard<std::mutex> lock(m_index_mutex);
+#endif
+    if (index_stale()) {
+      build_index();
+    }
+  }
+
+  // linear lookup by canonical name, for use before the indexes are built
+  static size_t find_slot_by_name(const std::vector<ArgumentDef> &args,
+                                  const std::string &name) {
+    for (size_t slot = 0; slot < args.size(); ++slot) {
+      if (args[slot].name == name) {
+        return slot;
+      }
+    }
+    return SlotTable::npos;
+  }
+
+  // keyword slots are positions in m_kw_args. keys are inserted in
+  // definition order and the first insertion wins, so lookups resolve to the
+  // same argument the old linear scan found first.
+  void build_index() const {
+    m_short_index.clear();
+    m_long_index.clear();
+    m_kw_name_index.clear();
+    m_pos_name_index.clear();
+    m_pos_choices.resize(m_pos_args.size());
+    for (size_t slot = 0; slot < m_pos_args.size(); ++slot) {
+      m_pos_name_index.insert(m_pos_args[slot].name, slot);
+      m_pos_choices[slot].build(m_pos_args[slot].choices);
+    }
+    m_kw_choices.resize(m_kw_args.size());
+    m_long_sorted.clear();
+    m_flag_slots.resize(m_kw_args.size());
+    m_required_slots.resize(m_kw_args.size());
+    m_help_slot = SlotTable::npos;
+    for (size_t slot = 0; slot < m_kw_args.size(); ++slot) {
+      const ArgumentDef &arg = m_kw_args[slot];
+      if (arg.type == ArgType_Flag) {
+        m_flag_slots.set(slot);
+      }
+      if (arg.required && !arg.is_help_flag) {
+        m_required_slots.set(slot);
+      }
+      if (arg.is_help_flag && m_help_slot == SlotTable::npos) {
+        m_help_slot = slot;
+      }
+      m_kw_name_index.insert(arg.name, slot);
+      m_kw_choices[slot].build(arg.choices);
+      // the canonical name matches both short and long flags
+      m_short_index.insert(arg.name, slot);
+      add_long_name(arg.name, slot);
+      for (size_t i = 0; i < arg.aliases.size(); ++i) {
+        const std::string &alias = arg.aliases[i];
+        if (alias.length() == 2 && alias[0] == '-') {
+          m_short_index.insert(alias.substr(1), slot); // "-f" -> "f"
+        } else if (alias.length() > 2 && alias.compare(0, 2, "--") == 0) {
+          add_long_name(alias.substr(2), slot); // "--force" -> "force"
+        }
+      }
+    }
+    std::sort(m_long_sorted.begin(), m_long_sorted.end());
+
+    m_compiled_groups.resize(m_groups.size());
+    for (size_t i = 0; i < m_groups.size(); ++i) {
+      CompiledGroup &compiled = m_compiled_groups[i];
+      compiled.trigger = m_kw_name_index.find(m_groups[i].trigger);
+      compiled.members.resize(m_kw_args.size());
+      for (size_t j = 0; j < m_groups[i].names.size(); ++j) {
+        compiled.members.set(m_kw_name_index.find(m_groups[i].names[j]));
+      }
+    }
+
+    // subcommand dispatch: names first, so they shadow any equal alias
+    m_command_index.clear();
+    m_command_list.clear();
+    m_ambiguous_alias.clear();
+    for (std::map<std::string, command_ptr>::const_iterator it =
+             m_commands.begin();
+         it != m_commands.end(); ++it) {
+      m_command_index.insert(it->first, m_command_list.size());
+      m_command_list.push_back(it->second);
+    }
+    for (size_t child = 0; child < m_command_list.size(); ++child) {
+      const std::vector<std::string> &aliases =
+          m_command_list[child]->get_aliases();
+      for (size_t i = 0; i < aliases.size(); ++i) {
+        if (m_command_index.insert(aliases[i], child)) {
+          continue;
+        }
+        size_t existing = m_command_index.find(aliases[i]);
+        if (existing == child || existing == ambiguous_command ||
+            m_command_list[existing]->get_name() == aliases[i]) {
+          continue;
+        }
+        m_command_index.assign(aliases[i], ambiguous_command);
+        if (m_ambiguous_alias.empty()) {
+          m_ambiguous_alias = aliases[i];
+        }
+      }
+    }
+
+    // byte table for combined short flags (e.g., -xvzf)
+    m_short_char_slots.clear();
+    for (int c = 0; c < 256; ++c) {
+      char ch = static_cast<char>(c);
+      size_t slot = m_short_index.find(&ch, 1);
+      if (slot != SlotTable::npos) {
+        m_short_char_slots.resize(256, 0u);
+        m_short_char_slots[c] = static_cast<unsigned int>(slot + 1);
+      }
+    }
+    m_indexed_alias_count = subcommand_alias_count();
+    m_index_stale = false;
+  }
+
+  void add_long_name(const std::string &name, size_t slot) const {
+    if (m_long_index.insert(name, slot)) {
+      LongName entry;
+      entry.name = name;
+      entry.slot = slot;
+      m_long_sorted.push_back(entry);
+    }
+  }
+
+  /**
+   * keyword slot of the only option with a long name starting with prefix;
+   * npos if none does. if several options do, npos is returned and their
+   * names are listed in candidates (e.g., "--verbose, --version").
+   * binary search plus a scan of the k matching names; nothing is
+   * allocated unless the prefix is ambiguous.
+   */
+  size_t find_long_prefix_slot(const char *prefix, size_t len,
+                               std::string &candidates) const {
+    candidates.clear();
+    const lexer::StringRef key = {prefix, len};
+    const std::vector<LongName>::const_iterator first =
+        std::lower_bound(m_long_sorted.begin(), m_long_sorted.end(), key);
+    std::vector<LongName>::const_iterator it = first;
+    size_t found = SlotTable::npos;
+    bool ambiguous = false;
+    for (; it != m_long_sorted.end() &&
+           it->name.compare(0, len, prefix, len) == 0;
+         ++it) {
+      if (found == SlotTable::npos) {
+        found = it->slot;
+      } else if (it->slot != found) {
+        ambiguous = true;
+      }
+    }
+    if (!ambiguous) {
+      return found;
+    }
+    for (std::vector<LongName>::const_iterator match = first; match != it;
+         ++match) {
+      if (!candidates.empty()) {
+        candidates += ", ";
+      }
+      candidates += "--";
+      candidates += match->name;
+    }
+    return SlotTable::npos;
+  }
+
+  // keyword slot of a single-character short flag, or npos
+  size_t find_short_char_slot(char c) const {
+    if (m_short_char_slots.empty()) {
+      return SlotTable::npos;
+    }
+    return static_cast<size_t>(
+               m_short_char_slots[static_cast<unsigned char>(c)]) -
+           1;
+  }
+
+  Command &add_group(GroupKind kind, const std::string &trigger,
+                     const std::vector<std::string> &names) {
+    if (names.empty()) {
+      throw std::invalid_argument("argument group has no options.");
+    }
+    if (kind == GroupKind_Requires &&
+        get_keyword_slot(trigger) == SlotTable::npos) {
+      throw std::invalid_argument("unknown option '" + trigger + "' in group.");
+    }
+    for (size_t i = 0; i < names.size(); ++i) {
+      if (get_keyword_slot(names[i]) == SlotTable::npos) {
+        throw std::invalid_argument("unknown option '" + names[i] +
+                                    "' in group.");
+      }
+    }
+    ArgGroup group;
+    group.kind = kind;
+    group.trigger = trigger;
+    group.names = names;
+    invalidate_index();
+    m_groups.push_back(group);
+    return *this;
+  }
+
+  // first violated group constraint or missing required option, as an error
+  // message; empty if the given keyword slots satisfy all of them
+  std::string check_keyword_constraints(const SlotSet &given) const {
+    if (!given.contains(m_required_slots)) {
+      return "missing required option: " +
+             m_kw_args[given.first_missing(m_required_slots)]
+                 .get_display_name();
+    }
+    for (size_t i = 0; i < m_compiled_groups.size(); ++i) {
+      const CompiledGroup &compiled = m_compiled_groups[i];
+      const ArgGroup &group = m_groups[i];
+      switch (group.kind) {
+      case GroupKind_Exclusive:
+        if (given.count_and(compiled.members) > 1) {
+          return "options " + group_names(group, &given) +
+                 " cannot be used together";
+        }
+        break;
+      case GroupKind_AtLeastOne:
+        if (given.count_and(compiled.members) == 0) {
+          return "one of the options " + group_names(group, nullptr) +
+                 " is required";
+        }
+        break;
+      case GroupKind_Requires:
+        if (given.test(compiled.trigger) && !given.contains(compiled.members)) {
+          return "option --" + group.trigger + " requires --" +
+                 m_kw_args[given.first_missing(compiled.members)].name;
+        }
+        break;
+      }
+    }
+    return std::string();
+  }
+
+  // "--a, --b" for the group's options (only the given ones, if given is set)
+  std::string group_names(const ArgGroup &group, const SlotSet *given) const {
+    std::string names;
+    for (size_t i = 0; i < group.names.size(); ++i) {
+      if (given && !given->test(m_kw_name_index.find(group.names[i]))) {
+        continue;
+      }
+      names += (names.empty() ? "--" : ", --") + group.names[i];
+    }
+    return names;
+  }
+
+  // find keyword argument slot by flag name (without dashes); npos if unknown
+  size_t find_keyword_slot(const char *flag_name, size_t len,
+                           bool is_short_flag_kind) const {
+    return is_short_flag_kind ? m_short_index.find(flag_name, len)
+                              : m_long_index.find(flag_name, len);
+  }
+
+  // find keyword argument definition by flag name
+  const ArgumentDef *find_keyword_arg(
+      const std::string &flag_name_value, // name part only (e.g., "f", "force")
+      bool is_short_flag_kind) const {
+    size_t slot = find_keyword_slot(flag_name_value.data(),
+                                    flag_name_value.size(), is_short_flag_kind);
+    return slot == SlotTable::npos ? nullptr : &m_kw_args[slot];
+  }
+
+  // parses [text, text + len) as a whole decimal integer
+  static bool parse_int_text(const char *text, size_t len, long long &out) {
+    size_t i = 0;
+    bool negative = false;
+    if (len > 0 && (text[0] == '-' || text[0] == '+')) {
+      negative = text[0] == '-';
+      i = 1;
+    }
+    if (i == len) {
+      return false;
+    }
+    unsigned long long magnitude = 0;
+    const unsigned long long limit =
+        negative ? static_cast<unsigned long long>(LLONG_MAX) + 1ULL
+                 : static_cast<unsigned long long>(LLONG_MAX);
+    for (; i < len; ++i) {
+      if (text[i] < '0' || text[i] > '9') {
+        return false;
+      }
+      unsigned digit = static_cast<unsigned>(text[i] - '0');
+      if (magnitude > (limit - digit) / 10) {
+        return false; // out of range
+      }
+      magnitude = magnitude * 10 + digit;
+    }
+    out = negative ? static_cast<long long>(0ULL - magnitude)
+                   : static_cast<long long>(magnitude);
+    return true;
+  }
+
+  // parses [text, text + len) as a whole decimal floating point number
+  static bool parse_double_text(const char *text, size_t len, double &out) {
+    char buffer[64];
+    if (len == 0 || len >= sizeof(buffer)) {
+      return false;
+    }
+    for (size_t i = 0; i < len; ++i) {
+      char c = text[i];
+      if (!((c >= '0' && c <= '9') || c == '.' || c == '-' || c == '+' ||
+            c == 'e' || c == 'E')) {
+        return false; // also rejects inf/nan and hex floats
+      }
+      buffer[i] = c;
+    }
+    buffer[len] = '\0';
+    char *end = nullptr;
+    out = std::strtod(buffer, &end);
+    return end == buffer + len;
+  }
+
+  /**
+   * converts a token to a number for ArgType_MultipleInt/MultipleDouble.
+   * literals convert directly; identifiers and strings (argv text) are
+   * parsed; a short flag whose name is a number ("-5" on the command line)
+   * reads as that number negated.
+   */
+  static bool token_to_int(const lexer::Token &token, long long &out) {
+    switch (token.get_kind()) {
+    case lexer::TokIntLit:
+      out = token.get_int_value();
+      return true;
+    case lexer::TokId:
+    case lexer::TokStrLit:
+      return parse_int_text(token.get_string_ref_start(),
+                            token.get_string_ref_length(), out);
+    case lexer::TokFlagShort: {
+      const char *name = token.get_string_ref_start();
+      size_t len = token.get_string_ref_length();
+      if (len == 0 || name[0] < '0' || name[0] > '9' ||
+          !parse_int_text(name, len, out)) {
+        return false;
+      }
+      out = -out;
+      return true;
+    }
+    default:
+      return false;
+    }
+  }
+
+  static bool token_to_double(const lexer::Token &token, double &out) {
+    switch (token.get_kind()) {
+    case lexer::TokIntLit:
+      out = static_cast<double>(token.get_int_value());
+      return true;
+    case lexer::TokFloatLit:
+      out = token.get_float_value();
+      return true;
+    case lexer::TokId:
+    case lexer::TokStrLit:
+      return parse_double_text(token.get_string_ref_start(),
+                               token.get_string_ref_length(), out);
+    case lexer::TokFlagShort: {
+      const char *name = token.get_string_ref_start();
+      size_t len = token.get_string_ref_length();
+      if (len == 0 || ((name[0] < '0' || name[0] > '9') && name[0] != '.') ||
+          !parse_double_text(name, len, out)) {
+        return false;
+      }
+      out = -out;
+      return true;
+    }
+    default:
+      return false;
+    }
+  }
+
+  static bool is_number_token(const lexer::Token &token, ArgType type) {
+    long long int_value;
+    double double_value;
+    return type == ArgType_MultipleInt ? token_to_int(token, int_value)
+                                       : token_to_double(token, double_value);
+  }
+
+  /**
+   * looks a value token up in an argument's choices. on a match the slot
+   * value holds the choice (a view of the definition's string in
+   * string-view mode); otherwise an error listing the choices is set on
+   * result.
+   */
+  bool match_choice(const ChoiceTable &table, const ArgumentDef &arg,
+                    bool positional, const lexer::Token &token,
+                    ArgValue &value, size_t &ordinal,
+                    ParseResult &result) const;
+
+  static void print_choices(std::ostream &os, const ArgumentDef &arg) {
+    if (arg.choices.empty()) {
+      return;
+    }
+    os << " {";
+    for (size_t i = 0; i < arg.choices.size(); ++i) {
+      os << (i ? "|" : "") << arg.choices[i];
+    }
+    os << "}";
+  }
+
+  // "--" ends option parsing in pass-through mode: TokDoubleMinus when lexed
+  // from a string, a short flag named "-" when classified from argv
+  static bool is_terminator(const lexer::Token &token) {
+    return token.get_kind() == lexer::TokDoubleMinus ||
+           (token.get_kind() == lexer::TokFlagShort &&
+            token.get_string_ref_length() == 1 &&
+            token.get_string_ref_start()[0] == '-');
+  }
+
+  // true for a short flag token naming a defined option; such a token ends
+  // a run of numbers even if its name is numeric
+  bool is_known_short_flag(const lexer::Token &token) const {
+    return token.get_kind() == lexer::TokFlagShort &&
+           find_keyword_slot(token.get_string_ref_start(),
+                             token.get_string_ref_length(),
+                             true) != SlotTable::npos;
+  }
+
+  // makes value an empty int or double list, reusing existing list storage
+  static void start_number_list(ArgValue &value, ArgType type) {
+    if (type == ArgType_MultipleInt && value.is_int_vector() &&
+        value.get_int_vector_ptr_unsafe()) {
+      value.get_int_vector_ptr_unsafe()->clear();
+    } else if (type == ArgType_MultipleDouble && value.is_double_vector() &&
+               value.get_double_vector_ptr_unsafe()) {
+      value.get_double_vector_ptr_unsafe()->clear();
+    } else if (type == ArgType_MultipleInt) {
+      value = ArgValue(std::vector<long long>());
+    } else {
+      value = ArgValue(std::vector<double>());
+    }
+  }
+
+  // appends the run of number tokens at index to value (a list started by
+  // start_number_list); returns how many were consumed
+  template <typename Cursor>
+  size_t consume_numbers(Cursor &cursor, size_t &index, ArgType type,
+                         ArgValue &value) const {
+    size_t count = 0;
+    if (type == ArgType_MultipleInt) {
+      std::vector<long long> *values = value.get_int_vector_ptr_unsafe();
+      long long number;
+      while (cursor.has(index) && !is_known_short_flag(cursor[index]) &&
+             token_to_int(cursor[index], number)) {
+        values->push_back(number);
+        ++index;
+        ++count;
+      }
+    } else {
+      std::vector<double> *values = value.get_double_vector_ptr_unsafe();
+      double number;
+      while (cursor.has(index) && !is_known_short_flag(cursor[index]) &&
+             token_to_double(cursor[index], number)) {
+        values->push_back(number);
+        ++index;
+        ++count;
+      }
+    }
+    return count;
+  }
+
+  /**
+   * text of a list value for a positional sink. identifiers and plain
+   * string literals are referenced in place; escaped strings and literals
+   * are rendered into scratch. only identifiers and strings continue a
+   * list, matching the collecting path.
+   */
+  static bool token_text(const lexer::Token &token, bool first,
+                         std::string &scratch, lexer::StringRef &out) {
+    switch (token.get_kind()) {
+    case lexer::TokId:
+      out.start = token.get_string_ref_start();
+      out.length = token.get_string_ref_length();
+      return true;
+    case lexer::TokStrLit:
+      out.start = token.get_string_ref_start();
+      out.length = token.get_string_ref_length();
+      if (std::memchr(out.start, '\\', out.length)) {
+        scratch = token.get_str_lit_value();
+        out.start = scratch.data();
+        out.length = scratch.size();
+      }
+      return true;
+    default:
+      break;
+    }
+    if (!first) {
+      return false;
+    }
+    std::ostringstream os;
+    switch (token.get_kind()) {
+    case lexer::TokIntLit:
+      os << token.get_int_value();
+      break;
+    case lexer::TokFloatLit:
+      os << token.get_float_value();
+      break;
+    case lexer::TokTrue:
+      os << "true";
+      break;
+    case lexer::TokFalse:
+      os << "false";
+      break;
+    case lexer::TokTimes:
+      os << "*";
+      break;
+    default:
+      return false;
+    }
+    scratch = os.str();
+    out.start = scratch.data();
+    out.length = scratch.size();
+    return true;
+  }
+
+  // true if parse_token_value() converts token for a single-valued
+  // expected_type; lazy results validate with this at parse time and
+  // convert on first read
+  static bool accepts_single_value(const lexer::Token &token,
+                                   ArgType expected_type) {
+    if (expected_type != ArgType_Single &&
+        expected_type != ArgType_Positional) {
+      return false;
+    }
+    switch (token.get_kind()) {
+    case lexer::TokIntLit:
+    case lexer::TokFloatLit:
+    case lexer::TokTrue:
+    case lexer::TokFalse:
+    case lexer::TokStrLit:
+    case lexer::TokId:
+    case lexer::TokTimes:
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  // moves a parsed value into its result slot. strings are assigned to the
+  // slot's string, reusing its capacity
+  static void store_value(ArgValue &slot, ArgValue &value) {
+    if (value.is_string() && slot.is_string()) {
+      lexer::StringRef ref = value.get_string_ref();
+      slot.set_string(ref.start, ref.length);
+    } else {
+      slot.swap(value);
+    }
+  }
+
+  // appends a string value to a list; no-op for others
+  static void push_string(std::vector<std::string> &values,
+                          const ArgValue &value) {
+    if (value.is_string()) {
+      lexer::StringRef ref = value.get_string_ref();
+      values.push_back(std::string(ref.start, ref.length));
+    }
+  }
+
+  // helper to parse a single token into an ArgValue based on expected type
+  // returns ArgValue (which manages memory for string/vector)
+  static ArgValue parse_token_value(const lexer::Token &token,
+                                    ArgType expected_type) {
+    lexer::TokenKind kind = token.get_kind();
+
+    // allow broader range of tokens to be interpreted as strings if expected
+    bool expect_string =
+        (expected_type == ArgType_Single || expected_type == ArgType_Multiple ||
+         expected_type == ArgType_Positional);
 
     switch (kind) {
     case lexer::TokIntLit:
@@ -832,7 +2631,8 @@ private:
       break;
     case lexer::TokId:
       if (expect_string)
-        return ArgValue(token.get_id_value());
+        return ArgValue(token.get_string_ref_start(),
+                        token.get_string_ref_length());
       break;
     case lexer::TokTimes:
       if (expect_string)
@@ -856,6 +2656,7 @@ private:
       }
     }
     if (!help_exists) {
+      invalidate_index();
       std::vector<std::string> help_aliases;
       help_aliases.push_back("-h");
       help_aliases.push_back("--help");
@@ -887,67 +2688,223 @@ public:
   std::string command_path;  // full path of the executed command (e.g., "git
                              // remote add")
 
-  // map storing parsed keyword argument values (name -> value)
-  std::map<std::string, ArgValue> keyword_values;
-  // map storing parsed positional argument values (name -> value)
-  std::map<std::string, ArgValue> positional_values;
+  // parsed values indexed by argument slot, i.e. the argument's position in
+  // m_command->get_keyword_args() / get_positional_args(), plus the slot
+  // base. each command on the parsed path stores its values after its
+  // parent's, so a reused result keeps separate storage for all of them.
+  // only slots in the given sets hold a value; defaults stay in the command
+  // definitions and are read from there (see get_kw_slot_value and
+  // get_pos_slot_value).
+  mutable std::vector<ArgValue> keyword_slots;
+  mutable std::vector<ArgValue> positional_slots;
+  size_t keyword_slot_base;
+  size_t positional_slot_base;
+  SlotSet keyword_given;    // keyword slots given on the command line
+  SlotSet positional_given; // positional slots given on the command line
+  // optional positional slots [begin, end) that take their default value
+  size_t positional_default_begin;
+  size_t positional_default_end;
+  // ordinal of the matched choice, for given slots of arguments with choices
+  std::vector<size_t> keyword_choices;
+  std::vector<size_t> positional_choices;
+
+  // pass-through mode: original text of the arguments the parser did not
+  // take, in order, and of those after "--" (the terminator itself is not
+  // included). nothing is copied: spans point into the parsed input. when
+  // parsing argv, each span is a whole NUL-terminated argv element, so
+  // const_cast<char *>(span.start) can be handed to execv as is.
+  std::vector<lexer::StringRef> unknown_args;
+  std::vector<lexer::StringRef> remainder_args;
+
+  // lazy mode: single values are kept as their token and converted on first
+  // read (then memoized); the bits mark slots still holding a token
+  std::vector<lexer::Token> keyword_tokens;
+  std::vector<lexer::Token> positional_tokens;
+  mutable SlotSet keyword_pending;
+  mutable SlotSet positional_pending;
 
   // pointer to the command definition for default value lookup
   const Command *m_command;
 
   ParseResult()
-      : status(ParserStatus_Success), exit_code(0), m_command(nullptr) {}
+      : status(ParserStatus_Success), exit_code(0), keyword_slot_base(0),
+        positional_slot_base(0), positional_default_begin(0),
+        positional_default_end(0),
+        m_command(nullptr), m_lazy_values(false), m_pass_through(false) {}
+
+  /**
+   * in lazy mode, single-valued arguments are only checked at parse time;
+   * the token is kept and converted on first read. tokens point into the
+   * parsed input (argv or the command line string), which must outlive
+   * the result. reads then update the result, so a lazy result must not be
+   * read from several threads at once. the mode survives reset().
+   */
+  void set_lazy_values(bool lazy) { m_lazy_values = lazy; }
+  bool is_lazy_values() const { return m_lazy_values; }
+
+  /**
+   * in pass-through mode, unknown options, arguments beyond the last
+   * positional and everything after a "--" terminator are collected in
+   * unknown_args / remainder_args instead of failing the parse. nothing is
+   * copied: the spans point into the parsed input (argv, the command line
+   * string, or a response file mapped by the ParseScratch), which must
+   * outlive the result, as with set_lazy_values. the mode survives reset().
+   */
+  void set_pass_through(bool pass_through) { m_pass_through = pass_through; }
+  bool is_pass_through() const { return m_pass_through; }
+
+  // returns to the freshly constructed state while keeping the capacity of
+  // the strings and slot storage, so the object can be parsed into again.
+  // slot values are kept, not destroyed: nothing reads a slot whose given
+  // bit is clear, and the next parse reuses their strings and lists
+  void reset() {
+    status = ParserStatus_Success;
+    exit_code = 0;
+    error_message.clear();
+    command_path.clear();
+    keyword_slot_base = 0;
+    positional_slot_base = 0;
+    keyword_given.resize(0);
+    positional_given.resize(0);
+    keyword_choices.clear();
+    positional_choices.clear();
+    unknown_args.clear();
+    remainder_args.clear();
+    positional_default_begin = 0;
+    positional_default_end = 0;
+    keyword_pending.resize(0);
+    positional_pending.resize(0);
+    m_command = nullptr;
+  }
+
+  // --- Slot Access ---
+
+  // storage of a slot of m_command (see keyword_slots)
+  ArgValue &keyword_slot(size_t slot) const {
+    return keyword_slots[keyword_slot_base + slot];
+  }
+  ArgValue &positional_slot(size_t slot) const {
+    return positional_slots[positional_slot_base + slot];
+  }
+
+  // value of a keyword slot: the parsed value if it was given, otherwise the
+  // argument's default (may be none); nullptr if out of range
+  const ArgValue *get_kw_slot_value(size_t slot) const {
+    if (!m_command || slot >= m_command->get_keyword_args().size()) {
+      return nullptr;
+    }
+    if (!keyword_given.test(slot)) {
+      return &m_command->get_keyword_args()[slot].default_value;
+    }
+    if (keyword_pending.test(slot)) {
+      ArgValue value = Command::parse_token_value(
+          keyword_tokens[slot], m_command->get_keyword_args()[slot].type);
+      Command::store_value(keyword_slot(slot), value);
+      keyword_pending.unset(slot);
+    }
+    return &keyword_slot(slot);
+  }
+
+  // value of a positional slot: the parsed value if it was given, its
+  // default if it was left out, nullptr if it holds none
+  const ArgValue *get_pos_slot_value(size_t slot) const {
+    if (positional_given.test(slot)) {
+      if (positional_pending.test(slot)) {
+        ArgValue value = Command::parse_token_value(
+            positional_tokens[slot],
+            m_command->get_positional_args()[slot].type);
+        Command::store_value(positional_slot(slot), value);
+        positional_pending.unset(slot);
+      }
+      return &positional_slot(slot);
+    }
+    if (m_command && slot >= positional_default_begin &&
+        slot < positional_default_end) {
+      return &m_command->get_positional_args()[slot].default_value;
+    }
+    return nullptr;
+  }
+
+  // true if the keyword slot was given on the command line
+  bool was_kw_slot_given(size_t slot) const {
+    return keyword_given.test(slot);
+  }
+
+  // ordinal (index into ArgumentDef::choices) of a slot's value: the parsed
+  // choice if given, else the default's; npos if neither is a choice
+  size_t get_kw_slot_choice(size_t slot) const {
+    if (!m_command || slot >= m_command->get_keyword_args().size()) {
+      return SlotTable::npos;
+    }
+    if (keyword_given.test(slot)) {
+      return keyword_choices[slot];
+    }
+    return default_choice(m_command->get_keyword_args()[slot]);
+  }
+
+  size_t get_pos_slot_choice(size_t slot) const {
+    if (!m_command || slot >= m_command->get_positional_args().size()) {
+      return SlotTable::npos;
+    }
+    if (positional_given.test(slot)) {
+      return positional_choices[slot];
+    }
+    if (slot >= positional_default_begin && slot < positional_default_end) {
+      return default_choice(m_command->get_positional_args()[slot]);
+    }
+    return SlotTable::npos;
+  }
+
+  // choice ordinals by name; npos if unknown, missing or not a choice
+  size_t get_kw_choice(const std::string &name) const {
+    return m_command ? get_kw_slot_choice(m_command->get_keyword_slot(name))
+                     : SlotTable::npos;
+  }
+
+  size_t get_pos_choice(const std::string &name) const {
+    return m_command ? get_pos_slot_choice(m_command->get_positional_slot(name))
+                     : SlotTable::npos;
+  }
+
+  // --- Keyword Argument Getters (by Name) ---
 
   // check if a keyword arg was provided (doesn't check type)
   bool has_kw_arg(const std::string &name) const {
-    return keyword_values.find(name) != keyword_values.end();
+    return find_kw_value(name) != nullptr;
   }
 
   // getters returning pointers, nullptr if missing or wrong type
   const bool *get_kw_arg_bool(const std::string &name) const {
-    std::map<std::string, ArgValue>::const_iterator it =
-        keyword_values.find(name);
-    if (it != keyword_values.end()) {
-      return it->second.get_bool();
-    }
-    return nullptr;
+    const ArgValue *value = find_kw_value(name);
+    return value ? value->get_bool() : nullptr;
   }
 
   const long long *get_kw_arg_int(const std::string &name) const {
-    std::map<std::string, ArgValue>::const_iterator it =
-        keyword_values.find(name);
-    if (it != keyword_values.end()) {
-      return it->second.get_int();
-    }
-    return nullptr;
+    const ArgValue *value = find_kw_value(name);
+    return value ? value->get_int() : nullptr;
   }
 
   const double *get_kw_arg_double(const std::string &name) const {
-    std::map<std::string, ArgValue>::const_iterator it =
-        keyword_values.find(name);
-    if (it != keyword_values.end()) {
-      return it->second.get_double();
-    }
-    return nullptr;
+    const ArgValue *value = find_kw_value(name);
+    return value ? value->get_double() : nullptr;
   }
 
   const std::string *get_kw_arg_string(const std::string &name) const {
-    std::map<std::string, ArgValue>::const_iterator it =
-        keyword_values.find(name);
-    if (it != keyword_values.end()) {
-      return it->second.get_string();
-    }
-    return nullptr;
+    const ArgValue *value = find_kw_value(name);
+    return value ? value->get_string() : nullptr;
+  }
+
+  // view of a string value; {nullptr, 0} if missing or wrong type. valid
+  // until this result is reset or parsed into again
+  lexer::StringRef get_kw_arg_string_ref(const std::string &name) const {
+    const ArgValue *value = find_kw_value(name);
+    return value ? value->get_string_ref() : lexer::StringRef();
   }
 
   const std::vector<std::string> *
   get_kw_arg_list(const std::string &name) const {
-    std::map<std::string, ArgValue>::const_iterator it =
-        keyword_values.find(name);
-    if (it != keyword_values.end()) {
-      return it->second.get_string_vector();
-    }
-    return nullptr;
+    const ArgValue *value = find_kw_value(name);
+    return value ? value->get_string_vector() : nullptr;
   }
 
   // getters returning value or the argument's default if missing/wrong type
@@ -955,64 +2912,35 @@ public:
     const bool *ptr = get_kw_arg_bool(name);
     if (ptr)
       return *ptr;
-    if (m_command) {
-      const std::vector<ArgumentDef> &defs = m_command->get_keyword_args();
-      for (size_t i = 0; i < defs.size(); ++i) {
-        if (defs[i].name == name) {
-          const bool *def_ptr = defs[i].default_value.get_bool();
-          return def_ptr ? *def_ptr : false;
-        }
-      }
-    }
-    return false;
+    const ArgumentDef *def = find_kw_def(name);
+    const bool *def_ptr = def ? def->default_value.get_bool() : nullptr;
+    return def_ptr ? *def_ptr : false;
   }
 
   long long find_kw_arg_int(const std::string &name) const {
     const long long *ptr = get_kw_arg_int(name);
     if (ptr)
       return *ptr;
-    if (m_command) {
-      const std::vector<ArgumentDef> &defs = m_command->get_keyword_args();
-      for (size_t i = 0; i < defs.size(); ++i) {
-        if (defs[i].name == name) {
-          const long long *def_ptr = defs[i].default_value.get_int();
-          return def_ptr ? *def_ptr : 0;
-        }
-      }
-    }
-    return 0;
+    const ArgumentDef *def = find_kw_def(name);
+    const long long *def_ptr = def ? def->default_value.get_int() : nullptr;
+    return def_ptr ? *def_ptr : 0;
   }
 
   double find_kw_arg_double(const std::string &name) const {
     const double *ptr = get_kw_arg_double(name);
     if (ptr)
       return *ptr;
-    if (m_command) {
-      const std::vector<ArgumentDef> &defs = m_command->get_keyword_args();
-      for (size_t i = 0; i < defs.size(); ++i) {
-        if (defs[i].name == name) {
-          const double *def_ptr = defs[i].default_value.get_double();
-          return def_ptr ? *def_ptr : 0.0;
-        }
-      }
-    }
-    return 0.0;
+    const ArgumentDef *def = find_kw_def(name);
+    const double *def_ptr = def ? def->default_value.get_double() : nullptr;
+    return def_ptr ? *def_ptr : 0.0;
   }
 
   std::string find_kw_arg_string(const std::string &name) const {
-    const std::string *ptr = get_kw_arg_string(name);
-    if (ptr)
-      return *ptr;
-    if (m_command) {
-      const std::vector<ArgumentDef> &defs = m_command->get_keyword_args();
-      for (size_t i = 0; i < defs.size(); ++i) {
-        if (defs[i].name == name) {
-          const std::string *def_ptr = defs[i].default_value.get_string();
-          return def_ptr ? *def_ptr : "";
-        }
-      }
-    }
-    return "";
+    const ArgValue *value = find_kw_value(name);
+    if (value && value->is_string())
+      return value->get_string_value();
+    const ArgumentDef *def = find_kw_def(name);
+    return def ? def->default_value.get_string_value() : "";
   }
 
   // returns a copy of the vector or the argument's default if missing
@@ -1020,212 +2948,505 @@ public:
     const std::vector<std::string> *ptr = get_kw_arg_list(name);
     if (ptr)
       return *ptr;
-    if (m_command) {
-      const std::vector<ArgumentDef> &defs = m_command->get_keyword_args();
-      for (size_t i = 0; i < defs.size(); ++i) {
-        if (defs[i].name == name) {
-          const std::vector<std::string> *def_ptr =
-              defs[i].default_value.get_string_vector();
-          return def_ptr ? *def_ptr : std::vector<std::string>();
-        }
-      }
-    }
-    return std::vector<std::string>();
+    const ArgumentDef *def = find_kw_def(name);
+    const std::vector<std::string> *def_ptr =
+        def ? def->default_value.get_string_vector() : nullptr;
+    return def_ptr ? *def_ptr : std::vector<std::string>();
+  }
+
+  // numeric lists (ArgType_MultipleInt/MultipleDouble); nullptr if missing
+  // or wrong type
+  const std::vector<long long> *
+  get_kw_arg_int_list(const std::string &name) const {
+    const ArgValue *value = find_kw_value(name);
+    return value ? value->get_int_vector() : nullptr;
+  }
+
+  const std::vector<double> *
+  get_kw_arg_double_list(const std::string &name) const {
+    const ArgValue *value = find_kw_value(name);
+    return value ? value->get_double_vector() : nullptr;
+  }
+
+  // views over a numeric list without copying; empty if missing or wrong
+  // type. valid until this result is reset or parsed into again
+  ValueSpan<long long> find_kw_arg_int_span(const std::string &name) const {
+    const std::vector<long long> *ptr = get_kw_arg_int_list(name);
+    return ptr ? ValueSpan<long long>(*ptr) : ValueSpan<long long>();
+  }
+
+  ValueSpan<double> find_kw_arg_double_span(const std::string &name) const {
+    const std::vector<double> *ptr = get_kw_arg_double_list(name);
+    return ptr ? ValueSpan<double>(*ptr) : ValueSpan<double>();
   }
 
   // --- Positional Argument Getters (by Name) ---
 
   // check if a positional arg was provided (doesn't check type)
   bool has_pos_arg(const std::string &name) const {
-    return positional_values.find(name) != positional_values.end();
+    return find_pos_value(name) != nullptr;
   }
 
   // getters returning pointers, nullptr if missing or wrong type
   const bool *get_pos_arg_bool(const std::string &name) const {
-    std::map<std::string, ArgValue>::const_iterator it =
-        positional_values.find(name);
-    if (it != positional_values.end()) {
-      return it->second.get_bool();
+    const ArgValue *value = find_pos_value(name);
+    return value ? value->get_bool() : nullptr;
+  }
+
+  const long long *get_pos_arg_int(const std::string &name) const {
+    const ArgValue *value = find_pos_value(name);
+    return value ? value->get_int() : nullptr;
+  }
+
+  const double *get_pos_arg_double(const std::string &name) const {
+    const ArgValue *value = find_pos_value(name);
+    return value ? value->get_double() : nullptr;
+  }
+
+  const std::string *get_pos_arg_string(const std::string &name) const {
+    const ArgValue *value = find_pos_value(name);
+    return value ? value->get_string() : nullptr;
+  }
+
+  lexer::StringRef get_pos_arg_string_ref(const std::string &name) const {
+    const ArgValue *value = find_pos_value(name);
+    return value ? value->get_string_ref() : lexer::StringRef();
+  }
+
+  const std::vector<std::string> *
+  get_pos_arg_list(const std::string &name) const {
+    const ArgValue *value = find_pos_value(name);
+    return value ? value->get_string_vector() : nullptr;
+  }
+
+  // getters returning value or the argument's default if missing/wrong type
+  bool find_pos_arg_bool(const std::string &name) const {
+    const bool *ptr = get_pos_arg_bool(name);
+    if (ptr)
+      return *ptr;
+    const ArgumentDef *def = find_pos_def(name);
+    const bool *def_ptr = def ? def->default_value.get_bool() : nullptr;
+    return def_ptr ? *def_ptr : false;
+  }
+
+  long long find_pos_arg_int(const std::string &name) const {
+    const long long *ptr = get_pos_arg_int(name);
+    if (ptr)
+      return *ptr;
+    const ArgumentDef *def = find_pos_def(name);
+    const long long *def_ptr = def ? def->default_value.get_int() : nullptr;
+    return def_ptr ? *def_ptr : 0;
+  }
+
+  double find_pos_arg_double(const std::string &name) const {
+    const double *ptr = get_pos_arg_double(name);
+    if (ptr)
+      return *ptr;
+    const ArgumentDef *def = find_pos_def(name);
+    const double *def_ptr = def ? def->default_value.get_double() : nullptr;
+    return def_ptr ? *def_ptr : 0.0;
+  }
+
+  std::string find_pos_arg_string(const std::string &name) const {
+    const ArgValue *value = find_pos_value(name);
+    if (value && value->is_string())
+      return value->get_string_value();
+    const ArgumentDef *def = find_pos_def(name);
+    return def ? def->default_value.get_string_value() : "";
+  }
+
+  // returns a copy of the vector or the argument's default if missing
+  std::vector<std::string> find_pos_arg_list(const std::string &name) const {
+    const std::vector<std::string> *ptr = get_pos_arg_list(name);
+    if (ptr)
+      return *ptr;
+    const ArgumentDef *def = find_pos_def(name);
+    const std::vector<std::string> *def_ptr =
+        def ? def->default_value.get_string_vector() : nullptr;
+    return def_ptr ? *def_ptr : std::vector<std::string>();
+  }
+
+  // numeric lists (ArgType_MultipleInt/MultipleDouble); nullptr if missing
+  // or wrong type
+  const std::vector<long long> *
+  get_pos_arg_int_list(const std::string &name) const {
+    const ArgValue *value = find_pos_value(name);
+    return value ? value->get_int_vector() : nullptr;
+  }
+
+  const std::vector<double> *
+  get_pos_arg_double_list(const std::string &name) const {
+    const ArgValue *value = find_pos_value(name);
+    return value ? value->get_double_vector() : nullptr;
+  }
+
+  // views over a numeric list without copying; empty if missing or wrong
+  // type. valid until this result is reset or parsed into again
+  ValueSpan<long long> find_pos_arg_int_span(const std::string &name) const {
+    const std::vector<long long> *ptr = get_pos_arg_int_list(name);
+    return ptr ? ValueSpan<long long>(*ptr) : ValueSpan<long long>();
+  }
+
+  ValueSpan<double> find_pos_arg_double_span(const std::string &name) const {
+    const std::vector<double> *ptr = get_pos_arg_double_list(name);
+    return ptr ? ValueSpan<double>(*ptr) : ValueSpan<double>();
+  }
+
+private:
+  static size_t default_choice(const ArgumentDef &arg) {
+    if (!arg.default_value.is_string()) {
+      return SlotTable::npos;
     }
-    return nullptr;
+    lexer::StringRef value = arg.default_value.get_string_ref();
+    for (size_t i = 0; i < arg.choices.size(); ++i) {
+      if (arg.choices[i].size() == value.length &&
+          arg.choices[i].compare(0, value.length, value.start,
+                                 value.length) == 0) {
+        return i;
+      }
+    }
+    return SlotTable::npos;
+  }
+
+  // name -> slot shims over the command's index; the help flag has no value
+  const ArgValue *find_kw_value(const std::string &name) const {
+    if (!m_command) {
+      return nullptr;
+    }
+    size_t slot = m_command->get_keyword_slot(name);
+    if (slot >= m_command->get_keyword_args().size() ||
+        m_command->get_keyword_args()[slot].is_help_flag) {
+      return nullptr;
+    }
+    return get_kw_slot_value(slot);
   }
 
-  const long long *get_pos_arg_int(const std::string &name) const {
-    std::map<std::string, ArgValue>::const_iterator it =
-        positional_values.find(name);
-    if (it != positional_values.end()) {
-      return it->second.get_int();
-    }
-    return nullptr;
+  const ArgValue *find_pos_value(const std::string &name) const {
+    return m_command ? get_pos_slot_value(m_command->get_positional_slot(name))
+                     : nullptr;
   }
 
-  const double *get_pos_arg_double(const std::string &name) const {
-    std::map<std::string, ArgValue>::const_iterator it =
-        positional_values.find(name);
-    if (it != positional_values.end()) {
-      return it->second.get_double();
+  const ArgumentDef *find_kw_def(const std::string &name) const {
+    if (!m_command) {
+      return nullptr;
     }
-    return nullptr;
+    size_t slot = m_command->get_keyword_slot(name);
+    return slot == SlotTable::npos ? nullptr
+                                   : &m_command->get_keyword_args()[slot];
   }
 
-  const std::string *get_pos_arg_string(const std::string &name) const {
-    std::map<std::string, ArgValue>::const_iterator it =
-        positional_values.find(name);
-    if (it != positional_values.end()) {
-      return it->second.get_string();
+  const ArgumentDef *find_pos_def(const std::string &name) const {
+    if (!m_command) {
+      return nullptr;
     }
-    return nullptr;
+    size_t slot = m_command->get_positional_slot(name);
+    return slot == SlotTable::npos ? nullptr
+                                   : &m_command->get_positional_args()[slot];
   }
 
-  const std::vector<std::string> *
-  get_pos_arg_list(const std::string &name) const {
-    std::map<std::string, ArgValue>::const_iterator it =
-        positional_values.find(name);
-    if (it != positional_values.end()) {
-      return it->second.get_string_vector();
-    }
+  bool m_lazy_values;
+  bool m_pass_through;
+};
+
+template <typename T>
+const T *ArgHandle<T>::get(const ParseResult &result) const {
+  if (!m_command || result.m_command != m_command) {
     return nullptr;
   }
+  const ArgValue *value = m_positional ? result.get_pos_slot_value(m_slot)
+                                       : result.get_kw_slot_value(m_slot);
+  return value ? ArgTraits<T>::get(*value) : nullptr;
+}
 
-  // getters returning value or the argument's default if missing/wrong type
-  bool find_pos_arg_bool(const std::string &name) const {
-    const bool *ptr = get_pos_arg_bool(name);
-    if (ptr)
-      return *ptr;
-    if (m_command) {
-      const std::vector<ArgumentDef> &defs = m_command->get_positional_args();
-      for (size_t i = 0; i < defs.size(); ++i) {
-        if (defs[i].name == name) {
-          const bool *def_ptr = defs[i].default_value.get_bool();
-          return def_ptr ? *def_ptr : false;
-        }
-      }
+template <typename T>
+T ArgHandle<T>::find(const ParseResult &result) const {
+  const T *ptr = get(result);
+  if (ptr) {
+    return *ptr;
+  }
+  if (m_command) {
+    const ArgumentDef &def = m_positional
+                                 ? m_command->get_positional_args()[m_slot]
+                                 : m_command->get_keyword_args()[m_slot];
+    const T *def_ptr = ArgTraits<T>::get(def.default_value);
+    if (def_ptr) {
+      return *def_ptr;
     }
+  }
+  return T();
+}
+
+template <typename T>
+bool ArgHandle<T>::was_given(const ParseResult &result) const {
+  if (!m_command || result.m_command != m_command) {
     return false;
   }
+  return m_positional ? result.positional_given.test(m_slot)
+                      : result.was_kw_slot_given(m_slot);
+}
 
-  long long find_pos_arg_int(const std::string &name) const {
-    const long long *ptr = get_pos_arg_int(name);
-    if (ptr)
-      return *ptr;
-    if (m_command) {
-      const std::vector<ArgumentDef> &defs = m_command->get_positional_args();
-      for (size_t i = 0; i < defs.size(); ++i) {
-        if (defs[i].name == name) {
-          const long long *def_ptr = defs[i].default_value.get_int();
-          return def_ptr ? *def_ptr : 0;
-        }
-      }
-    }
-    return 0;
+inline bool Command::match_choice(const ChoiceTable &table,
+                                  const ArgumentDef &arg,
+                                  bool positional, const lexer::Token &token,
+                                  ArgValue &value, size_t &ordinal,
+                                  ParseResult &result) const {
+  std::string scratch;
+  lexer::StringRef text;
+  ordinal = token_text(token, true, scratch, text)
+                ? table.find(text.start, text.length)
+                : ChoiceTable::npos;
+  if (ordinal != ChoiceTable::npos) {
+    const std::string &choice = arg.choices[ordinal];
+    value.set_string(choice.data(), choice.size());
+    return true;
   }
+  result.status = ParseResult::ParserStatus_ParseError;
+  result.error_message =
+      positional
+          ? "invalid choice for positional argument '" + arg.name + "'"
+          : "invalid choice for option " + arg.get_display_name();
+  result.error_message += " (choose from ";
+  for (size_t i = 0; i < arg.choices.size(); ++i) {
+    result.error_message += (i ? ", " : "") + arg.choices[i];
+  }
+  result.error_message += ")";
+  std::cerr << "error: " << result.error_message << "\n\n";
+  result.exit_code = 1;
+  return false;
+}
 
-  double find_pos_arg_double(const std::string &name) const {
-    const double *ptr = get_pos_arg_double(name);
-    if (ptr)
-      return *ptr;
-    if (m_command) {
-      const std::vector<ArgumentDef> &defs = m_command->get_positional_args();
-      for (size_t i = 0; i < defs.size(); ++i) {
-        if (defs[i].name == name) {
-          const double *def_ptr = defs[i].default_value.get_double();
-          return def_ptr ? *def_ptr : 0.0;
+inline ParseResult
+Command::parse(const std::vector<lexer::Token> &tokens,
+               size_t &current_token_index,
+               const std::string &command_path_prefix) const {
+  VectorCursor cursor(tokens);
+  return parse_cursor(cursor, current_token_index, command_path_prefix);
+}
+
+template <typename Cursor>
+ParseResult Command::parse_cursor(Cursor &cursor, size_t &current_token_index,
+                                  const std::string &command_path_prefix) const {
+  ParseResult result;
+  parse_cursor_into(cursor, current_token_index, command_path_prefix, result);
+  return result;
+}
+
+template <typename Cursor>
+const Command *Command::resolve_cursor(Cursor &cursor, size_t &index) const {
+  ensure_index();
+  size_t pos_index = 0;
+  size_t i = index;
+  while (cursor.has(i)) {
+    const lexer::Token &token = cursor[i];
+    lexer::TokenKind kind = token.get_kind();
+    const ArgType pos_type = pos_index < m_pos_args.size()
+                                 ? m_pos_args[pos_index].type
+                                 : ArgType_Flag;
+
+    if ((kind == lexer::TokFlagShort || kind == lexer::TokFlagLong) &&
+        !((pos_type == ArgType_MultipleInt ||
+           pos_type == ArgType_MultipleDouble) &&
+          is_number_token(token, pos_type) && !is_known_short_flag(token))) {
+      size_t len = token.get_string_ref_length();
+      size_t slot = find_keyword_slot(token.get_string_ref_start(), len,
+                                      kind == lexer::TokFlagShort);
+      ++i;
+      if ((kind == lexer::TokFlagShort && len > 1) ||
+          slot == SlotTable::npos || m_flag_slots.test(slot)) {
+        continue; // flag cluster, unknown option or boolean flag
+      }
+      ArgType type = m_kw_args[slot].type;
+      if (type == ArgType_MultipleInt || type == ArgType_MultipleDouble) {
+        while (cursor.has(i) && !is_known_short_flag(cursor[i]) &&
+               is_number_token(cursor[i], type)) {
+          ++i;
+        }
+      } else {
+        // one value, or values up to the next flag for ArgType_Multiple
+        while (cursor.has(i) && !is_flag_token(cursor, i)) {
+          ++i;
+          if (type != ArgType_Multiple) {
+            break;
+          }
         }
       }
+      continue;
     }
-    return 0.0;
-  }
 
-  std::string find_pos_arg_string(const std::string &name) const {
-    const std::string *ptr = get_pos_arg_string(name);
-    if (ptr)
-      return *ptr;
-    if (m_command) {
-      const std::vector<ArgumentDef> &defs = m_command->get_positional_args();
-      for (size_t i = 0; i < defs.size(); ++i) {
-        if (defs[i].name == name) {
-          const std::string *def_ptr = defs[i].default_value.get_string();
-          return def_ptr ? *def_ptr : "";
-        }
+    if (kind == lexer::TokId) {
+      size_t child = m_command_index.find(token.get_string_ref_start(),
+                                          token.get_string_ref_length());
+      if (child != SlotTable::npos && child != ambiguous_command) {
+        size_t next = i + 1;
+        const Command *found =
+            m_command_list[child]->resolve_cursor(cursor, next);
+        index = next;
+        return found;
       }
     }
-    return "";
-  }
 
-  // returns a copy of the vector or the argument's default if missing
-  std::vector<std::string> find_pos_arg_list(const std::string &name) const {
-    const std::vector<std::string> *ptr = get_pos_arg_list(name);
-    if (ptr)
-      return *ptr;
-    if (m_command) {
-      const std::vector<ArgumentDef> &defs = m_command->get_positional_args();
-      for (size_t i = 0; i < defs.size(); ++i) {
-        if (defs[i].name == name) {
-          const std::vector<std::string> *def_ptr =
-              defs[i].default_value.get_string_vector();
-          return def_ptr ? *def_ptr : std::vector<std::string>();
-        }
+    if (pos_index >= m_pos_args.size()) {
+      break; // parse would stop here too
+    }
+    if (pos_type == ArgType_MultipleInt ||
+        pos_type == ArgType_MultipleDouble) {
+      while (cursor.has(i) && !is_known_short_flag(cursor[i]) &&
+             is_number_token(cursor[i], pos_type)) {
+        ++i;
+      }
+    } else if (pos_type == ArgType_Multiple) {
+      while (cursor.has(i) && !is_flag_token(cursor, i)) {
+        ++i;
       }
+    } else {
+      ++i;
     }
-    return std::vector<std::string>();
+    ++pos_index;
   }
-};
+  return this;
+}
 
-inline ParseResult
-Command::parse(const std::vector<lexer::Token> &tokens,
-               size_t &current_token_index,
-               const std::string &command_path_prefix) const {
-  ParseResult result;
-  result.m_command = this;
-  result.command_path = command_path_prefix + m_name;
+template <typename Cursor>
+void Command::parse_cursor_into(Cursor &cursor, size_t &current_token_index,
+                                const std::string &command_path_prefix,
+                                ParseResult &result) const {
+  ensure_index();
+  // subcommands receive result.command_path itself as their prefix, so the
+  // path is extended in place; help output needs only the prefix part
+  const size_t prefix_length = command_path_prefix.size();
+  if (&command_path_prefix != &result.command_path) {
+    result.command_path.assign(command_path_prefix);
+  }
+  result.command_path.append(m_name);
   // initialize exit code for potential errors or help requests
   result.exit_code = 0; // default to 0 for success before handler runs
 
-  std::map<std::string, bool> keyword_args_seen;
   size_t current_positional_arg_index = 0;
 
-  for (std::vector<ArgumentDef>::const_iterator it = m_kw_args.begin();
-       it != m_kw_args.end(); ++it) {
-    const ArgumentDef &arg = *it;
-    if (arg.is_help_flag) {
-      continue;
-    }
-    result.keyword_values[arg.name] = arg.default_value;
+  // values are stored by slot and only read when their given bit is set, so
+  // slots are neither seeded with defaults nor cleared. a subcommand's slots
+  // follow its parent's and the vectors never shrink, so a reused result
+  // keeps the storage of every command it has parsed
+  if (result.m_command) {
+    result.keyword_slot_base += result.m_command->m_kw_args.size();
+    result.positional_slot_base += result.m_command->m_pos_args.size();
+  }
+  result.m_command = this;
+  if (result.keyword_slots.size() <
+      result.keyword_slot_base + m_kw_args.size()) {
+    result.keyword_slots.resize(result.keyword_slot_base + m_kw_args.size());
+  }
+  result.keyword_given.resize(m_kw_args.size());
+  if (result.positional_slots.size() <
+      result.positional_slot_base + m_pos_args.size()) {
+    result.positional_slots.resize(result.positional_slot_base +
+                                   m_pos_args.size());
+  }
+  result.positional_given.resize(m_pos_args.size());
+  result.keyword_choices.resize(m_kw_args.size());
+  result.positional_choices.resize(m_pos_args.size());
+  result.positional_default_begin = 0;
+  result.positional_default_end = 0;
+  const bool lazy = result.is_lazy_values();
+  result.keyword_pending.resize(lazy ? m_kw_args.size() : 0);
+  result.positional_pending.resize(lazy ? m_pos_args.size() : 0);
+  if (lazy) {
+    result.keyword_tokens.resize(m_kw_args.size());
+    result.positional_tokens.resize(m_pos_args.size());
   }
 
-  while (current_token_index < tokens.size()) {
-    const lexer::Token &token = tokens[current_token_index];
+  const bool pass_through = result.is_pass_through();
+
+  while (cursor.has(current_token_index)) {
+    const lexer::Token &token = cursor[current_token_index];
     lexer::TokenKind kind = token.get_kind();
 
+    // pass-through: "--" ends option parsing; the rest is kept verbatim
+    if (pass_through && is_terminator(token)) {
+      for (++current_token_index; cursor.has(current_token_index);
+           ++current_token_index) {
+        result.remainder_args.push_back(cursor.raw(current_token_index));
+      }
+      break;
+    }
+
+    // a negative number ("-5") for a numeric positional list is a value, not
+    // a flag, unless a short flag of that name exists
+    const bool negative_positional =
+        kind == lexer::TokFlagShort &&
+        current_positional_arg_index < m_pos_args.size() &&
+        (m_pos_args[current_positional_arg_index].type == ArgType_MultipleInt ||
+         m_pos_args[current_positional_arg_index].type ==
+             ArgType_MultipleDouble) &&
+        is_number_token(token, m_pos_args[current_positional_arg_index].type) &&
+        find_keyword_slot(token.get_string_ref_start(),
+                          token.get_string_ref_length(),
+                          true) == SlotTable::npos;
+
     // check for keyword arguments/flags (TokFlagShort, TokFlagLong)
-    if (kind == lexer::TokFlagShort || kind == lexer::TokFlagLong) {
-      std::string flag_name_str =
-          token.get_id_value(); // get name without dashes
+    if ((kind == lexer::TokFlagShort || kind == lexer::TokFlagLong) &&
+        !negative_positional) {
+      // name without dashes; points into the input, no allocation
+      const char *flag_name = token.get_string_ref_start();
+      size_t flag_name_len = token.get_string_ref_length();
       bool is_short_flag_kind = (kind == lexer::TokFlagShort);
 
-      if (is_short_flag_kind && flag_name_str.length() > 1) {
+      if (is_short_flag_kind && flag_name_len > 1) {
         current_token_index++;
 
-        for (size_t i = 0; i < flag_name_str.length(); ++i) {
-          std::string single_flag_char(1, flag_name_str[i]);
+        // fast path: one table load per character, then a single check that
+        // the whole cluster is made of plain boolean flags
+        const size_t max_cluster = 64;
+        size_t cluster_slots[max_cluster];
+        bool all_plain_flags = flag_name_len <= max_cluster;
+        for (size_t i = 0; all_plain_flags && i < flag_name_len; ++i) {
+          size_t slot = find_short_char_slot(flag_name[i]);
+          all_plain_flags = slot != SlotTable::npos &&
+                            m_flag_slots.test(slot) && slot != m_help_slot;
+          cluster_slots[i] = slot;
+        }
+        if (all_plain_flags) {
+          for (size_t i = 0; i < flag_name_len; ++i) {
+            result.keyword_given.set(cluster_slots[i]);
+            result.keyword_slot(cluster_slots[i]) = ArgValue(true);
+          }
+          continue;
+        }
+
+        // pass-through: a cluster with an unknown character is kept whole
+        if (pass_through) {
+          bool unknown = false;
+          for (size_t i = 0; i < flag_name_len && !unknown; ++i) {
+            unknown = find_short_char_slot(flag_name[i]) == SlotTable::npos;
+          }
+          if (unknown) {
+            result.unknown_args.push_back(cursor.raw(current_token_index - 1));
+            continue;
+          }
+        }
+
+        // slow path: report the first offending character in order
+        for (size_t i = 0; i < flag_name_len; ++i) {
+          std::string single_flag_char(1, flag_name[i]);
+          size_t char_slot = find_short_char_slot(flag_name[i]);
           const ArgumentDef *matched_arg =
-              find_keyword_arg(single_flag_char, true);
+              char_slot == SlotTable::npos ? nullptr : &m_kw_args[char_slot];
 
           if (!matched_arg) {
             result.status = ParseResult::ParserStatus_ParseError;
             result.error_message = "unknown option in combined flags: -";
             result.error_message += single_flag_char;
             std::cerr << "error: " << result.error_message << "\n\n";
-            generate_help(std::cerr, command_path_prefix);
+            generate_help(std::cerr, result.command_path.substr(0, prefix_length));
             result.exit_code = 1;
-            return result;
+            return;
           }
 
           if (matched_arg->is_help_flag) {
-            generate_help(std::cout, command_path_prefix);
+            generate_help(std::cout, result.command_path.substr(0, prefix_length));
             result.status = ParseResult::ParserStatus_HelpRequested;
             result.exit_code = 0; // help request is a successful exit
-            return result;
+            return;
           }
 
           // ensure combined flags are actually boolean flags
@@ -1234,22 +3455,51 @@ Command::parse(const std::vector<lexer::Token> &tokens,
             result.error_message = "option -" + single_flag_char +
                                    " requires a value and cannot be combined.";
             std::cerr << "error: " << result.error_message << "\n\n";
-            generate_help(std::cerr, command_path_prefix);
+            generate_help(std::cerr, result.command_path.substr(0, prefix_length));
             result.exit_code = 1;
-            return result;
+            return;
           }
 
           // mark as seen and set value to true
-          keyword_args_seen[matched_arg->name] = true;
-          result.keyword_values[matched_arg->name] = ArgValue(true);
+          result.keyword_given.set(char_slot);
+          result.keyword_slot(char_slot) = ArgValue(true);
         }
         continue;
       }
 
+      size_t matched_slot =
+          find_keyword_slot(flag_name, flag_name_len, is_short_flag_kind);
       const ArgumentDef *matched_arg =
-          find_keyword_arg(flag_name_str, is_short_flag_kind);
+          matched_slot == SlotTable::npos ? nullptr : &m_kw_args[matched_slot];
+
+      if (!matched_arg && !is_short_flag_kind && m_allow_abbrev) {
+        std::string candidates;
+        matched_slot =
+            find_long_prefix_slot(flag_name, flag_name_len, candidates);
+        if (!candidates.empty()) {
+          result.status = ParseResult::ParserStatus_ParseError;
+          result.error_message = "ambiguous option: --" +
+                                 std::string(flag_name, flag_name_len) +
+                                 " could match " + candidates;
+          std::cerr << "error: " << result.error_message << "\n\n";
+          generate_help(std::cerr,
+                        result.command_path.substr(0, prefix_length));
+          result.exit_code = 1;
+          return;
+        }
+        if (matched_slot != SlotTable::npos) {
+          matched_arg = &m_kw_args[matched_slot];
+        }
+      }
+
+      if (!matched_arg && pass_through) {
+        result.unknown_args.push_back(cursor.raw(current_token_index));
+        current_token_index++;
+        continue;
+      }
 
       if (!matched_arg) {
+        std::string flag_name_str(flag_name, flag_name_len);
         result.status = ParseResult::ParserStatus_ParseError;
         result.error_message = "unknown option: ";
         result.error_message += (is_short_flag_kind ? "-" : "--");
@@ -1287,54 +3537,104 @@ Command::parse(const std::vector<lexer::Token> &tokens,
           std::cerr << "\n";
         }
 
-        generate_help(std::cerr, command_path_prefix);
+        generate_help(std::cerr, result.command_path.substr(0, prefix_length));
         result.exit_code = 1;
-        return result;
+        return;
       }
 
       // if this is the specifically marked help flag, handle it immediately.
       if (matched_arg->is_help_flag) {
-        generate_help(std::cout, command_path_prefix);
+        generate_help(std::cout, result.command_path.substr(0, prefix_length));
         result.status = ParseResult::ParserStatus_HelpRequested;
         result.exit_code = 0; // help request is a successful exit
-        return result;
+        return;
       }
 
       current_token_index++; // consume the flag token itself
-      keyword_args_seen[matched_arg->name] = true;
+      bool first_use = !result.keyword_given.test(matched_slot);
+      result.keyword_given.set(matched_slot);
+      ArgValue &slot_value = result.keyword_slot(matched_slot);
 
       // handle argument value based on type
       if (matched_arg->type == ArgType_Flag) {
-        result.keyword_values[matched_arg->name] = ArgValue(true);
+        slot_value = ArgValue(true);
+      } else if (matched_arg->type == ArgType_MultipleInt ||
+                 matched_arg->type == ArgType_MultipleDouble) {
+        // numbers go straight into a contiguous array, appending to a list
+        // default like ArgType_Multiple does
+        if (first_use) {
+          const ArgValue &default_value = matched_arg->default_value;
+          if (matched_arg->type == ArgType_MultipleInt
+                  ? default_value.is_int_vector()
+                  : default_value.is_double_vector()) {
+            slot_value = default_value;
+          } else {
+            start_number_list(slot_value, matched_arg->type);
+          }
+        }
+        if (consume_numbers(cursor, current_token_index, matched_arg->type,
+                            slot_value) == 0) {
+          bool missing = !cursor.has(current_token_index) ||
+                         is_flag_token(cursor, current_token_index);
+          result.status = ParseResult::ParserStatus_ParseError;
+          result.error_message =
+              missing ? "option " + matched_arg->get_display_name() +
+                            " requires a value."
+                      : "invalid value for option " +
+                            matched_arg->get_display_name();
+          std::cerr << "error: " << result.error_message << "\n\n";
+          generate_help(std::cerr, result.command_path.substr(0, prefix_length));
+          result.exit_code = 1;
+          return;
+        }
       } else {
         // check if next token exists and is not another flag
-        if (current_token_index >= tokens.size() ||
-            tokens[current_token_index].get_kind() == lexer::TokFlagShort ||
-            tokens[current_token_index].get_kind() == lexer::TokFlagLong) {
+        if (!cursor.has(current_token_index) ||
+            cursor[current_token_index].get_kind() == lexer::TokFlagShort ||
+            cursor[current_token_index].get_kind() == lexer::TokFlagLong) {
           result.status = ParseResult::ParserStatus_ParseError;
           result.error_message = "option " + matched_arg->get_display_name() +
                                  " requires a value.";
           std::cerr << "error: " << result.error_message << "\n\n";
-          generate_help(std::cerr, command_path_prefix);
+          generate_help(std::cerr, result.command_path.substr(0, prefix_length));
           result.exit_code = 1;
-          return result;
+          return;
         }
 
-        const lexer::Token &value_token = tokens[current_token_index];
+        const lexer::Token &value_token = cursor[current_token_index];
+        if (!matched_arg->choices.empty()) {
+          if (!match_choice(m_kw_choices[matched_slot], *matched_arg,
+                            false, value_token, slot_value, result.keyword_choices[matched_slot],
+                            result)) {
+            generate_help(std::cerr,
+                          result.command_path.substr(0, prefix_length));
+            return;
+          }
+          current_token_index++;
+          continue;
+        }
+        // lazy results keep single values as tokens, checked but unconverted
+        const bool defer = lazy && matched_arg->type == ArgType_Single;
         ArgValue parsed_value =
-            parse_token_value(value_token, matched_arg->type);
-        if (parsed_value.is_none()) {
+            defer ? ArgValue()
+                  : parse_token_value(value_token, matched_arg->type);
+        if (defer ? !accepts_single_value(value_token, matched_arg->type)
+                  : parsed_value.is_none()) {
           result.status = ParseResult::ParserStatus_ParseError;
           result.error_message =
               "invalid value for option " + matched_arg->get_display_name();
           std::cerr << "error: " << result.error_message << "\n\n";
-          generate_help(std::cerr, command_path_prefix);
+          generate_help(std::cerr, result.command_path.substr(0, prefix_length));
           result.exit_code = 1;
-          return result;
+          return;
         }
 
-        if (matched_arg->type == ArgType_Single) {
-          result.keyword_values[matched_arg->name] = parsed_value;
+        if (defer) {
+          result.keyword_tokens[matched_slot] = value_token;
+          result.keyword_pending.set(matched_slot);
+          current_token_index++;
+        } else if (matched_arg->type == ArgType_Single) {
+          store_value(slot_value, parsed_value);
           current_token_index++;
         } else if (matched_arg->type == ArgType_Multiple) {
           // ensure value type is string for multiple
@@ -1344,43 +3644,40 @@ Command::parse(const std::vector<lexer::Token> &tokens,
                 "internal error: expected string value for multiple option " +
                 matched_arg->name;
             std::cerr << "error: " << result.error_message << "\n\n";
-            generate_help(std::cerr, command_path_prefix);
+            generate_help(std::cerr, result.command_path.substr(0, prefix_length));
             result.exit_code = 1;
-            return result;
+            return;
           }
 
-          std::map<std::string, ArgValue>::iterator map_it =
-              result.keyword_values.find(matched_arg->name);
-          if (map_it == result.keyword_values.end() ||
-              !map_it->second.is_string_vector() || map_it->second.is_none()) {
-            result.keyword_values[matched_arg->name] =
-                ArgValue(std::vector<std::string>());
-            map_it = result.keyword_values.find(matched_arg->name);
+          // values append to a list default, which is copied on first use;
+          // otherwise start from an empty list (reusing a stale one's storage)
+          if (first_use && matched_arg->default_value.is_string_vector()) {
+            slot_value = matched_arg->default_value;
+          } else if (first_use && slot_value.is_string_vector() &&
+                     slot_value.get_string_vector_ptr_unsafe()) {
+            slot_value.get_string_vector_ptr_unsafe()->clear();
+          } else if (!slot_value.is_string_vector() || slot_value.is_none()) {
+            slot_value = ArgValue(std::vector<std::string>());
           }
 
           std::vector<std::string> *vec =
-              map_it->second.get_string_vector_ptr_unsafe();
+              slot_value.get_string_vector_ptr_unsafe();
           if (vec) {
-            const std::string *first_val_str_ptr = parsed_value.get_string();
-            if (first_val_str_ptr) {
-              vec->push_back(*first_val_str_ptr);
-            }
+            push_string(*vec, parsed_value);
 
             current_token_index++;
 
             // keep consuming values until next flag or end
             while (
-                current_token_index < tokens.size() &&
-                tokens[current_token_index].get_kind() != lexer::TokFlagShort &&
-                tokens[current_token_index].get_kind() != lexer::TokFlagLong) {
+                cursor.has(current_token_index) &&
+                cursor[current_token_index].get_kind() != lexer::TokFlagShort &&
+                cursor[current_token_index].get_kind() != lexer::TokFlagLong) {
               const lexer::Token &next_value_token =
-                  tokens[current_token_index];
+                  cursor[current_token_index];
               ArgValue next_parsed_value =
                   parse_token_value(next_value_token, ArgType_Single);
-              const std::string *next_val_str_ptr =
-                  next_parsed_value.get_string();
-              if (next_val_str_ptr) {
-                vec->push_back(*next_val_str_ptr);
+              if (next_parsed_value.is_string()) {
+                push_string(*vec, next_parsed_value);
                 current_token_index++;
               } else {
                 break;
@@ -1392,9 +3689,9 @@ Command::parse(const std::vector<lexer::Token> &tokens,
                 "internal error accessing vector for multiple values for " +
                 matched_arg->name;
             std::cerr << "error: " << result.error_message << "\n\n";
-            generate_help(std::cerr, command_path_prefix);
+            generate_help(std::cerr, result.command_path.substr(0, prefix_length));
             result.exit_code = 1;
-            return result;
+            return;
           }
         }
       }
@@ -1403,46 +3700,38 @@ Command::parse(const std::vector<lexer::Token> &tokens,
 
     // check for subcommand
     if (kind == lexer::TokId) {
-      std::string potential_subcommand_or_alias = token.get_id_value();
       command_ptr matched_subcommand;
 
-      // first, check if it's a direct name match
-      auto sub_it = m_commands.find(potential_subcommand_or_alias);
-      if (sub_it != m_commands.end()) {
-        matched_subcommand = sub_it->second;
-      } else {
-        // if not a direct name match, check aliases
-        for (std::map<std::string, command_ptr>::const_iterator it2 =
-                 m_commands.begin();
-             it2 != m_commands.end(); ++it2) {
-          const std::pair<const std::string, command_ptr> &pair = *it2;
-          if (pair.second->has_alias(potential_subcommand_or_alias)) {
-            // prevent aliasing to multiple commands
-            if (matched_subcommand) {
-              result.status = ParseResult::ParserStatus_ParseError;
-              result.error_message = "ambiguous alias '" +
-                                     potential_subcommand_or_alias +
-                                     "' matches multiple subcommands.";
-              std::cerr << "error: " << result.error_message << "\n\n";
-              generate_help(std::cerr, command_path_prefix);
-              result.exit_code = 1;
-              return result;
-            }
-            matched_subcommand = pair.second;
-          }
-        }
+      // one hashed lookup covers both names and aliases
+      size_t child = m_command_index.find(token.get_string_ref_start(),
+                                          token.get_string_ref_length());
+      if (child == ambiguous_command) {
+        std::string potential_subcommand_or_alias = token.get_id_value();
+        // prevent aliasing to multiple commands
+        result.status = ParseResult::ParserStatus_ParseError;
+        result.error_message = "ambiguous alias '" +
+                               potential_subcommand_or_alias +
+                               "' matches multiple subcommands.";
+        std::cerr << "error: " << result.error_message << "\n\n";
+        generate_help(std::cerr, result.command_path.substr(0, prefix_length));
+        result.exit_code = 1;
+        return;
+      }
+      if (child != SlotTable::npos) {
+        matched_subcommand = m_command_list[child];
       }
 
       // if a subcommand (by name or alias) was found
       if (matched_subcommand) {
         current_token_index++; // consume the subcommand/alias token
-        ParseResult sub_result = matched_subcommand->parse(
-            tokens, current_token_index, result.command_path + " ");
-
-        // propagate the result (success, error, or help request) from the
-        // subcommand.
-        return sub_result;
+        result.command_path += ' ';
+        // the subcommand refills the same result (success, error, or help
+        // request), which propagates to the caller.
+        matched_subcommand->parse_cursor_into(cursor, current_token_index,
+                                              result.command_path, result);
+        return;
       } else if (!m_commands.empty()) {
+        std::string potential_subcommand_or_alias = token.get_id_value();
         // Suggest similar subcommand/group
         size_t best_dist = (size_t)-1;
         std::string best_match;
@@ -1473,29 +3762,99 @@ Command::parse(const std::vector<lexer::Token> &tokens,
         } else {
           std::cerr << "\n";
         }
-        generate_help(std::cerr, command_path_prefix);
+        generate_help(std::cerr, result.command_path.substr(0, prefix_length));
         result.exit_code = 1;
-        return result;
+        return;
       }
     }
 
     // if not a flag/option or subcommand, treat as positional argument
-    if (current_positional_arg_index < m_pos_args.size()) {
+    if (current_positional_arg_index < m_pos_args.size() &&
+        (m_pos_args[current_positional_arg_index].type == ArgType_MultipleInt ||
+         m_pos_args[current_positional_arg_index].type ==
+             ArgType_MultipleDouble)) {
+      const ArgumentDef &pos_arg_def = m_pos_args[current_positional_arg_index];
+      ArgValue &slot_value =
+          result.positional_slot(current_positional_arg_index);
+      start_number_list(slot_value, pos_arg_def.type);
+      if (consume_numbers(cursor, current_token_index, pos_arg_def.type,
+                          slot_value) == 0) {
+        result.status = ParseResult::ParserStatus_ParseError;
+        result.error_message =
+            "invalid value for positional argument '" + pos_arg_def.name + "'";
+        std::cerr << "error: " << result.error_message << "\n\n";
+        generate_help(std::cerr, result.command_path.substr(0, prefix_length));
+        result.exit_code = 1;
+        return;
+      }
+      result.positional_given.set(current_positional_arg_index);
+      current_positional_arg_index++;
+    } else if (current_positional_arg_index < m_pos_args.size() &&
+               m_pos_args[current_positional_arg_index].sink) {
+      // streamed list: hand each value to the sink, store nothing
+      const ArgumentDef &pos_arg_def = m_pos_args[current_positional_arg_index];
+      std::string scratch;
+      lexer::StringRef value;
+      if (!token_text(token, true, scratch, value)) {
+        result.status = ParseResult::ParserStatus_ParseError;
+        result.error_message =
+            "invalid value for positional argument '" + pos_arg_def.name + "'";
+        std::cerr << "error: " << result.error_message << "\n\n";
+        generate_help(std::cerr, result.command_path.substr(0, prefix_length));
+        result.exit_code = 1;
+        return;
+      }
+      result.positional_given.set(current_positional_arg_index);
+      pos_arg_def.sink(value, pos_arg_def.sink_context);
+      current_token_index++;
+      while (cursor.has(current_token_index) &&
+             !is_flag_token(cursor, current_token_index) &&
+             token_text(cursor[current_token_index], false, scratch, value)) {
+        pos_arg_def.sink(value, pos_arg_def.sink_context);
+        current_token_index++;
+      }
+      current_positional_arg_index++;
+    } else if (current_positional_arg_index < m_pos_args.size() &&
+               !m_pos_args[current_positional_arg_index].choices.empty()) {
+      const ArgumentDef &pos_arg_def = m_pos_args[current_positional_arg_index];
+      if (!match_choice(m_pos_choices[current_positional_arg_index],
+                        pos_arg_def, true, token,
+                        result.positional_slot(current_positional_arg_index),
+                        result.positional_choices[current_positional_arg_index],
+                        result)) {
+        generate_help(std::cerr, result.command_path.substr(0, prefix_length));
+        return;
+      }
+      result.positional_given.set(current_positional_arg_index);
+      current_token_index++;
+      current_positional_arg_index++;
+    } else if (current_positional_arg_index < m_pos_args.size()) {
       const ArgumentDef &pos_arg_def = m_pos_args[current_positional_arg_index];
-      ArgValue parsed_value = parse_token_value(token, pos_arg_def.type);
+      const bool defer = lazy && pos_arg_def.type == ArgType_Single;
+      ArgValue parsed_value =
+          defer ? ArgValue() : parse_token_value(token, pos_arg_def.type);
 
-      if (parsed_value.is_none()) {
+      if (defer ? !accepts_single_value(token, pos_arg_def.type)
+                : parsed_value.is_none()) {
         result.status = ParseResult::ParserStatus_ParseError;
         result.error_message =
             "invalid value for positional argument '" + pos_arg_def.name + "'";
         std::cerr << "error: " << result.error_message << "\n\n";
-        generate_help(std::cerr, command_path_prefix);
+        generate_help(std::cerr, result.command_path.substr(0, prefix_length));
         result.exit_code = 1;
-        return result;
+        return;
       }
 
-      if (pos_arg_def.type == ArgType_Single) {
-        result.positional_values[pos_arg_def.name] = parsed_value;
+      if (defer) {
+        result.positional_tokens[current_positional_arg_index] = token;
+        result.positional_pending.set(current_positional_arg_index);
+        result.positional_given.set(current_positional_arg_index);
+        current_token_index++;
+        current_positional_arg_index++;
+      } else if (pos_arg_def.type == ArgType_Single) {
+        store_value(result.positional_slot(current_positional_arg_index),
+                    parsed_value);
+        result.positional_given.set(current_positional_arg_index);
         current_token_index++;
         current_positional_arg_index++;
       } else if (pos_arg_def.type == ArgType_Multiple) {
@@ -1506,40 +3865,50 @@ Command::parse(const std::vector<lexer::Token> &tokens,
                                  "multiple positional argument " +
                                  pos_arg_def.name;
           std::cerr << "error: " << result.error_message << "\n\n";
-          generate_help(std::cerr, command_path_prefix);
+          generate_help(std::cerr, result.command_path.substr(0, prefix_length));
           result.exit_code = 1;
-          return result;
+          return;
         }
 
-        std::vector<std::string> values;
-        // add the first value (must be string)
-        const std::string *first_val_str_ptr = parsed_value.get_string();
-        if (first_val_str_ptr) { // should always be true
-          values.push_back(*first_val_str_ptr);
+        // collect straight into the slot, reusing a list left by an earlier
+        // parse into the same result
+        ArgValue &slot_value =
+            result.positional_slot(current_positional_arg_index);
+        if (slot_value.is_string_vector() &&
+            slot_value.get_string_vector_ptr_unsafe()) {
+          slot_value.get_string_vector_ptr_unsafe()->clear();
+        } else {
+          slot_value = ArgValue(std::vector<std::string>());
         }
+        std::vector<std::string> &values =
+            *slot_value.get_string_vector_ptr_unsafe();
+        // add the first value (must be string)
+        push_string(values, parsed_value); // always a string here
 
         current_token_index++;
-        while (current_token_index < tokens.size() &&
+        while (cursor.has(current_token_index) &&
                !is_flag_token(
-                   tokens, current_token_index) /* && !is_subcommand(...) */) {
+                   cursor, current_token_index) /* && !is_subcommand(...) */) {
           // todo: add is_subcommand check more robustly?
           // currently relies on subcommand check earlier in loop
-          const lexer::Token &next_value_token = tokens[current_token_index];
+          const lexer::Token &next_value_token = cursor[current_token_index];
           // parse subsequent as strings
           ArgValue next_parsed_value =
               parse_token_value(next_value_token, ArgType_Single);
-          const std::string *next_val_str_ptr = next_parsed_value.get_string();
-          if (next_val_str_ptr) {
-            values.push_back(*next_val_str_ptr);
+          if (next_parsed_value.is_string()) {
+            push_string(values, next_parsed_value);
             current_token_index++;
           } else {
             break;
           }
         }
-        // add the vector to positional args map using ArgValue constructor
-        result.positional_values[pos_arg_def.name] = ArgValue(values);
+        result.positional_given.set(current_positional_arg_index);
         current_positional_arg_index++;
       }
+    } else if (pass_through) {
+      // no positional left to fill: hand the argument back to the caller
+      result.unknown_args.push_back(cursor.raw(current_token_index));
+      current_token_index++;
     } else {
       // Only treat as unexpected if not a string or identifier (quoted or
       // unquoted)
@@ -1552,9 +3921,9 @@ Command::parse(const std::vector<lexer::Token> &tokens,
         result.error_message = ss.str();
         // print error and help for this command to stderr
         std::cerr << "error: " << result.error_message << "\n\n";
-        generate_help(std::cerr, command_path_prefix);
+        generate_help(std::cerr, result.command_path.substr(0, prefix_length));
         result.exit_code = 1;
-        return result;
+        return;
       }
       // Otherwise, forcibly advance the token and positional argument index to
       // avoid infinite loop
@@ -1563,42 +3932,35 @@ Command::parse(const std::vector<lexer::Token> &tokens,
     }
   }
 
-  // check for required keyword arguments
-  for (std::vector<ArgumentDef>::const_iterator it = m_kw_args.begin();
-       it != m_kw_args.end(); ++it) {
-    const ArgumentDef &arg = *it;
-    // skip check for the automatic help flag
-    if (arg.is_help_flag)
-      continue;
-    if (arg.required &&
-        keyword_args_seen.find(arg.name) == keyword_args_seen.end()) {
-      result.status = ParseResult::ParserStatus_ParseError;
-      result.error_message =
-          "missing required option: " + arg.get_display_name();
-      std::cerr << "error: " << result.error_message << "\n\n";
-      generate_help(std::cerr, command_path_prefix);
-      result.exit_code = 1;
-      return result;
-    }
+  // check required keyword arguments and argument groups as bitmasks
+  std::string violation = check_keyword_constraints(result.keyword_given);
+  if (!violation.empty()) {
+    result.status = ParseResult::ParserStatus_ParseError;
+    result.error_message.swap(violation);
+    std::cerr << "error: " << result.error_message << "\n\n";
+    generate_help(std::cerr, result.command_path.substr(0, prefix_length));
+    result.exit_code = 1;
+    return;
   }
 
   // check for required positional arguments
   if (m_pos_args.size() > current_positional_arg_index) {
+    result.positional_default_begin = current_positional_arg_index;
     for (size_t i = current_positional_arg_index; i < m_pos_args.size(); ++i) {
       const ArgumentDef &pos_arg_def = m_pos_args[i];
+      result.positional_default_end = i;
       if (pos_arg_def.required) {
         result.status = ParseResult::ParserStatus_ParseError;
         result.error_message =
             "missing required positional argument: " + pos_arg_def.name;
         std::cerr << "error: " << result.error_message << "\n\n";
-        generate_help(std::cerr, command_path_prefix);
+        generate_help(std::cerr, result.command_path.substr(0, prefix_length));
         result.exit_code = 1;
-        return result;
-      } else {
-        // add default value for optional missing positional args
-        result.positional_values[pos_arg_def.name] = pos_arg_def.default_value;
+        return;
       }
+      // optional missing positional args read their default value
     }
+    result.positional_default_end = m_pos_args.size();
   }
 
   // only execute the handler if parsing was successful and no subcommand took
@@ -1611,164 +3973,228 @@ Command::parse(const std::vector<lexer::Token> &tokens,
   // succeeded, print help and set status to HelpRequested.
   if (!m_handler && !m_commands.empty() &&
       result.status == ParseResult::ParserStatus_Success) {
-    generate_help(std::cout, command_path_prefix);
+    generate_help(std::cout, result.command_path.substr(0, prefix_length));
     result.status = ParseResult::ParserStatus_HelpRequested;
     result.exit_code = 0;
   }
 
-  return result;
+  return;
 }
 
+/**
+ * working storage of one ArgumentParser::parse_into call: the token buffer
+ * of a lexed command line and the response files mapped while parsing
+ * argv. reusing one keeps its capacity. a parser can be used from several
+ * threads at once (after freeze()) when each thread passes its own result
+ * and scratch. response files stay mapped, and lazy or pass-through values
+ * read from them stay valid, until the scratch is used again.
+ */
+class ParseScratch {
+public:
+  ParseScratch() {}
+
+private:
+  // private copy constructor and assignment operator to prevent copying
+  ParseScratch(const ParseScratch &);
+  ParseScratch &operator=(const ParseScratch &);
+
+  friend class ArgumentParser;
+  std::vector<lexer::Token> m_tokens; // reused by parse_into(command_line)
+  ResponseFiles m_response_files;     // files mapped by the last argv parse
+};
+
 class ArgumentParser {
 public:
   ArgumentParser(std::string prog_name, std::string description = "")
       : m_program_name(prog_name), m_program_desc(description),
-        m_root_cmd(command_ptr(new Command(prog_name, description))) {}
+        m_root_cmd(command_ptr(new Command(prog_name, description))),
+        m_response_files_enabled(false) {}
 
   ~ArgumentParser() = default;
 
   // get a reference to the root command to add arguments or subcommands
   Command &get_root_command() { return *m_root_cmd; }
 
-  // parse command line arguments from main(argc, argv)
+  /**
+   * build the lookup indexes of every command and make the schema read-only
+   * (see Command::freeze). until then each parse first rebuilds the indexes
+   * of commands changed since the last parse; freeze before sharing the
+   * parser between threads.
+   */
+  ArgumentParser &freeze() {
+    m_root_cmd->freeze();
+    return *this;
+  }
+
+  /**
+   * expand "@file" arguments of parse(argc, argv) as response files (see
+   * ResponseFileCursor). off by default, since it changes the meaning of
+   * arguments starting with '@'. files stay mapped until the next parse
+   * that uses the same ParseScratch.
+   */
+  ArgumentParser &set_response_files(bool enabled) {
+    m_response_files_enabled = enabled;
+    return *this;
+  }
+  bool is_response_files() const { return m_response_files_enabled; }
+
+  // parse command line arguments from main(argc, argv); like parse_into,
+  // this uses the parser's scratch and is not reentrant
   ParseResult parse(int argc, char *argv[]) {
+    ParseResult result;
+    parse_into(argc, argv, result);
+    return result;
+  }
+
+  /**
+   * parse main(argc, argv) into an existing result, which is reset first.
+   * reusing one result keeps its capacity, so repeated parses (a REPL or a
+   * daemon) do not allocate in steady state. uses the parser's own scratch,
+   * so calls on one parser must not overlap; see the ParseScratch overload.
+   */
+  void parse_into(int argc, char *argv[], ParseResult &result) {
+    parse_into(argc, argv, result, m_scratch);
+  }
+
+  // reentrant parse_into(argc, argv, result): working storage is scratch
+  void parse_into(int argc, char *argv[], ParseResult &result,
+                  ParseScratch &scratch) {
+    result.reset();
     if (argc < 1) {
-      ParseResult error_result;
-      error_result.status = ParseResult::ParserStatus_ParseError;
-      error_result.error_message = "invalid arguments provided (argc < 1)";
-      error_result.exit_code = 1;
-      return error_result;
+      result.status = ParseResult::ParserStatus_ParseError;
+      result.error_message = "invalid arguments provided (argc < 1)";
+      result.exit_code = 1;
+      return;
     }
 
-    // Convert argv[1..argc-1] to vector<string>
-    std::vector<std::string> args;
-    for (int i = 1; i < argc; ++i) {
-      args.push_back(std::string(argv[i]));
+    if (!m_root_cmd) {
+      result.status = ParseResult::ParserStatus_ParseError;
+      result.error_message = "ArgumentParser is not initialized correctly.";
+      result.exit_code = 1;
+      return;
     }
-    // Mature CLI: treat each argv element as atomic, parse by CLI rules
-    std::vector<lexer::Token> tokens;
-    size_t pos = 0;
-    for (size_t i = 0; i < args.size(); ++i) {
-      const std::string &arg = args[i];
-      if (arg.size() > 2 && arg[0] == '-' && arg[1] == '-') {
-        // Long flag: --flag
-        tokens.push_back(
-            lexer::Token::make_long_flag(arg.c_str() + 2, arg.size() - 2,
-                                         lexer::Span(pos, pos + arg.size())));
-      } else if (arg.size() > 1 && arg[0] == '-' && arg != "-") {
-        // Short flag: -f or -abc
-        tokens.push_back(
-            lexer::Token::make_short_flag(arg.c_str() + 1, arg.size() - 1,
-                                          lexer::Span(pos, pos + arg.size())));
-      } else if ((arg.size() >= 2 &&
-                  ((arg[0] == '"' && arg[arg.size() - 1] == '"') ||
-                   (arg[0] == '\'' && arg[arg.size() - 1] == '\'')))) {
-        // Quoted string literal (remove quotes)
-        tokens.push_back(
-            lexer::Token::make_str_lit(arg.c_str() + 1, arg.size() - 2,
-                                       lexer::Span(pos, pos + arg.size())));
-      } else {
-        // All other arguments: treat as identifier (positional or value)
-        tokens.push_back(lexer::Token::make_id(
-            arg.c_str(), arg.size(), lexer::Span(pos, pos + arg.size())));
-      }
-      pos += arg.size() + 1;
+
+    if (m_response_files_enabled) {
+      parse_response_files(argc, argv, result, scratch.m_response_files);
+      return;
     }
 
+    // argv elements are classified as the parser reaches them; nothing is
+    // copied and no token vector is built
+    ArgvCursor cursor(argc, argv);
     size_t token_index = 0;
-    if (!m_root_cmd) {
-      ParseResult error_result;
-      error_result.status = ParseResult::ParserStatus_ParseError;
-      error_result.error_message =
-          "ArgumentParser is not initialized correctly.";
-      error_result.exit_code = 1;
-      return error_result;
-    }
-    ParseResult result = m_root_cmd->parse(tokens, token_index, "");
+    m_root_cmd->parse_cursor_into(cursor, token_index, std::string(), result);
     if (result.status == ParseResult::ParserStatus_Success &&
-        token_index < tokens.size()) {
-      result.status = ParseResult::ParserStatus_ParseError;
-      std::stringstream ss;
-      ss << "unexpected arguments starting from: ";
-      tokens[token_index].print(ss);
-      result.error_message = ss.str();
-      std::cerr << "error: " << result.error_message << "\n\n";
-      m_root_cmd->generate_help(std::cerr, "");
-      result.exit_code = 1;
-      return result;
+        cursor.has(token_index)) {
+      report_unexpected(cursor[token_index], result);
+    }
+  }
+
+  /**
+   * finds the leaf command named by argv without parsing it (see
+   * Command::resolve_command), e.g. to forward argv to a worker process.
+   * arg_index is set to the argv index of the first argument after the
+   * returned command's name (1 for the root command).
+   */
+  const Command *resolve_command(int argc, char *argv[],
+                                 size_t &arg_index) const {
+    ArgvCursor cursor(argc, argv);
+    size_t token_index = 0;
+    const Command *command = m_root_cmd->resolve_cursor(cursor, token_index);
+    arg_index = token_index + 1;
+    return command;
+  }
+
+  /**
+   * builds one token per argv[1..argc-1] element, in place: token names and
+   * values point into argv, which lives for the whole process. each element
+   * is atomic and classified by CLI rules (long flag, short flag(s), quoted
+   * literal with the quotes stripped, or identifier).
+   */
+  static void tokenize_argv(int argc, char *argv[],
+                            std::vector<lexer::Token> &tokens) {
+    tokens.clear();
+    if (argc < 2) {
+      return;
+    }
+    tokens.reserve(static_cast<size_t>(argc - 1));
+    size_t pos = 0;
+    for (int i = 1; i < argc; ++i) {
+      size_t len = std::strlen(argv[i]);
+      tokens.push_back(ArgvCursor::make_token(argv[i], len, pos));
+      pos += len + 1;
     }
-    return result;
   }
 
-  // parse command line arguments from a single string
+  // parse command line arguments from a single string (not reentrant)
   ParseResult parse(const std::string &command_line) {
+    ParseResult result;
+    parse_into(command_line, result);
+    return result;
+  }
+
+  /**
+   * parse a single command line string into an existing result, which is
+   * reset first. the line is lexed in place into a token buffer owned by
+   * the parser, so repeated calls reuse its capacity; calls on one parser
+   * must therefore not overlap (see the ParseScratch overload).
+   */
+  void parse_into(const std::string &command_line, ParseResult &result) {
+    parse_into(command_line, result, m_scratch);
+  }
+
+  // reentrant parse_into(command_line, result): tokens go into scratch
+  void parse_into(const std::string &command_line, ParseResult &result,
+                  ParseScratch &scratch) {
+    result.reset();
     if (!m_root_cmd) {
-      ParseResult error_result;
-      error_result.status = ParseResult::ParserStatus_ParseError;
-      error_result.error_message =
-          "ArgumentParser is not initialized correctly.";
-      error_result.exit_code = 1;
-      return error_result;
+      result.status = ParseResult::ParserStatus_ParseError;
+      result.error_message = "ArgumentParser is not initialized correctly.";
+      result.exit_code = 1;
+      return;
     }
 
     try {
-      lexer::Src source = lexer::Src::from_string(command_line, "<cli>");
-      std::vector<lexer::Token> tokens = lexer::Lexer::tokenize(source);
-
-      // filter out TokEof at the end
-      if (!tokens.empty() && tokens.back().get_kind() == lexer::TokEof) {
-        tokens.pop_back();
+      static const std::string cli_filename("<cli>");
+      std::vector<lexer::Token> &tokens = scratch.m_tokens;
+      tokens.clear();
+      lexer::Lexer lexer(cli_filename, command_line.data(),
+                         command_line.size(), tokens);
+      // TokEof is not needed by the command parser, so never emit it
+      lexer.set_kind_filter(lexer::all_token_kinds &
+                            ~lexer::kind_bit(lexer::TokEof));
+      while (!lexer.is_done()) {
+        lexer.lex_next();
       }
 
       size_t token_index = 0;
-      ParseResult result = m_root_cmd->parse(tokens, token_index, "");
-
-      // return early in the event of an error or help request from the parse
-      // call
-      if (result.status == ParseResult::ParserStatus_ParseError) {
-        return result;
-      }
-      if (result.status == ParseResult::ParserStatus_HelpRequested) {
-        return result;
-      }
+      VectorCursor cursor(tokens, command_line.data());
+      m_root_cmd->parse_cursor_into(cursor, token_index, std::string(),
+                                    result);
 
       // parsing succeeded, but not all tokens were consumed (and no subcommand
-      // handled them)
-      if (token_index < tokens.size()) {
-        result.status = ParseResult::ParserStatus_ParseError;
-        std::stringstream ss;
-        ss << "unexpected arguments starting from: ";
-        tokens[token_index].print(ss);
-        result.error_message = ss.str();
-        std::cerr << "error: " << result.error_message << "\n\n";
-        // show root help on unexpected trailing arguments error (to stderr)
-        m_root_cmd->generate_help(std::cerr, "");
-        result.exit_code = 1;
-        return result;
+      // handled them); errors and help requests are returned as they are
+      if (result.status == ParseResult::ParserStatus_Success &&
+          token_index < tokens.size()) {
+        report_unexpected(tokens[token_index], result);
       }
-
-      return result;
     } catch (const lexer::LexError &e) {
       std::cerr << "lexer error: " << e.what() << std::endl;
-      ParseResult error_result;
-      error_result.status = ParseResult::ParserStatus_ParseError;
-      error_result.error_message = e.what();
-      error_result.exit_code = 1;
+      result.reset();
+      result.status = ParseResult::ParserStatus_ParseError;
+      result.error_message = e.what();
+      result.exit_code = 1;
       // show root help on lexer error (to stderr)
-      if (m_root_cmd)
-        m_root_cmd->generate_help(std::cerr, "");
-      return error_result;
+      m_root_cmd->generate_help(std::cerr, "");
     } catch (const std::exception &e) {
       // catch standard exceptions that might arise
       std::cerr << "parser error: " << e.what() << std::endl;
-      ParseResult error_result;
-      error_result.status = ParseResult::ParserStatus_ParseError;
-      error_result.error_message = e.what();
-      error_result.exit_code = 1;
+      result.reset();
+      result.status = ParseResult::ParserStatus_ParseError;
+      result.error_message = e.what();
+      result.exit_code = 1;
       // show root help on general parser error (to stderr)
-      if (m_root_cmd)
-        m_root_cmd->generate_help(std::cerr, "");
-      return error_result;
+      m_root_cmd->generate_help(std::cerr, "");
     }
   }
 
@@ -1777,9 +4203,47 @@ private:
   ArgumentParser(const ArgumentParser &);
   ArgumentParser &operator=(const ArgumentParser &);
 
+  // parse_into(argc, argv) with response files expanded on the fly
+  void parse_response_files(int argc, char *argv[], ParseResult &result,
+                            ResponseFiles &files) {
+    files.clear();
+    try {
+      ResponseFileCursor cursor(argc, argv, files);
+      size_t token_index = 0;
+      m_root_cmd->parse_cursor_into(cursor, token_index, std::string(),
+                                    result);
+      if (result.status == ParseResult::ParserStatus_Success &&
+          cursor.has(token_index)) {
+        report_unexpected(cursor[token_index], result);
+      }
+    } catch (const std::exception &e) {
+      std::cerr << "error: " << e.what() << "\n\n";
+      result.reset();
+      result.status = ParseResult::ParserStatus_ParseError;
+      result.error_message = e.what();
+      result.exit_code = 1;
+      m_root_cmd->generate_help(std::cerr, "");
+    }
+  }
+
+  // trailing tokens no command consumed
+  void report_unexpected(const lexer::Token &token, ParseResult &result) {
+    result.status = ParseResult::ParserStatus_ParseError;
+    std::stringstream ss;
+    ss << "unexpected arguments starting from: ";
+    token.print(ss);
+    result.error_message = ss.str();
+    std::cerr << "error: " << result.error_message << "\n\n";
+    // show root help on unexpected trailing arguments error (to stderr)
+    m_root_cmd->generate_help(std::cerr, "");
+    result.exit_code = 1;
+  }
+
   std::string m_program_name;
   std::string m_program_desc;
   command_ptr m_root_cmd;
+  ParseScratch m_scratch; // used by the parse_into overloads without one
+  bool m_response_files_enabled;
 }; // class ArgumentParser
 
 /**
@@ -1791,6 +4255,16 @@ private:
 inline void generate_bash_completion(std::ostream &os, const std::string &prog_name, const Command &root_cmd) {
   // Helper to recursively emit command tree as bash arrays
   struct BashEmit {
+    // flag spelling as a variable name suffix ("--format" -> "__format")
+    static std::string bash_name(const std::string &flag) {
+      std::string name = flag;
+      for (size_t i = 0; i < name.size(); ++i) {
+        char c = name[i];
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_')) name[i] = '_';
+      }
+      return name;
+    }
+
     static void emit_command_tree(const Command &cmd, const std::string &prefix, std::ostream &os) {
       std::string arr_name = "_parser_cmds";
       if (!prefix.empty()) arr_name += "_" + prefix;
@@ -1826,6 +4300,23 @@ inline void generate_bash_completion(std::ostream &os, const std::string &prog_n
         }
       }
       os << ")\n";
+      // Values of options with choices, one array per flag spelling
+      for (size_t i = 0; i < kw.size(); ++i) {
+        if (kw[i].choices.empty()) continue;
+        std::vector<std::string> flags = kw[i].aliases;
+        flags.push_back("--" + kw[i].name);
+        for (size_t j = 0; j < flags.size(); ++j) {
+          if (j + 1 == flags.size() &&
+              std::find(kw[i].aliases.begin(), kw[i].aliases.end(), flags[j]) != kw[i].aliases.end()) {
+            continue; // --<name> is already an alias
+          }
+          os << "_parser_choices" << (prefix.empty() ? "" : "_" + prefix) << "_" << bash_name(flags[j]) << "=( ";
+          for (size_t k = 0; k < kw[i].choices.size(); ++k) {
+            os << "'" << kw[i].choices[k] << "' ";
+          }
+          os << ")\n";
+        }
+      }
       // Recurse for subcommands
       for (std::map<std::string, command_ptr>::const_iterator it = subs.begin(); it != subs.end(); ++it) {
         std::string sub_prefix = prefix.empty() ? it->first : (prefix + "_" + it->first);
@@ -1858,6 +4349,11 @@ inline void generate_bash_completion(std::ostream &os, const std::string &prog_n
   os << "    done\n";
   os << "    if [[ $found -eq 0 ]]; then break; fi\n";
   os << "  done\n";
+  os << "  local choice_arr=\"_parser_choices${cmd_path}_${prev//[^a-zA-Z0-9_]/_}[@]\"\n";
+  os << "  if [[ -n \"${!choice_arr}\" ]]; then\n";
+  os << "    COMPREPLY=( $(compgen -W \"${!choice_arr}\" -- \"$cur\") )\n";
+  os << "    return 0\n";
+  os << "  fi\n";
   os << "  eval opts=\"\\${!opt_arr}\"\n";
   os << "  eval cmds=\"\\${!arr_name}\"\n";
   os << "  COMPREPLY=( $(compgen -W \"${opts[*]} ${cmds[*]}\" -- \"$cur\") )\n";
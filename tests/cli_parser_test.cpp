@@ -1,9 +1,57 @@
 #include <cassert>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
 #include <sstream>
+#include <unistd.h>
+#include <new>
 #include "../include/lexer.hpp"
 #include "../include/parser.hpp"
 
+// heap allocations made while g_count_allocations is set (see
+// testSteadyStateAllocations); only toggled while no other threads run
+static bool g_count_allocations = false;
+static size_t g_allocation_count = 0;
+
+void *operator new(std::size_t size)
+{
+    if (g_count_allocations)
+        ++g_allocation_count;
+    void *ptr = std::malloc(size ? size : 1);
+    if (!ptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+// kept out of line so the compiler does not pair an inlined free() with
+// operator new and warn about mismatched allocation functions
+#if defined(__GNUC__)
+#define TEST_NOINLINE __attribute__((noinline))
+#else
+#define TEST_NOINLINE
+#endif
+
+TEST_NOINLINE void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+TEST_NOINLINE void operator delete(void *ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+// allocations made by one call of fn
+template <typename Fn>
+size_t count_allocations(Fn fn)
+{
+    g_allocation_count = 0;
+    g_count_allocations = true;
+    fn();
+    g_count_allocations = false;
+    return g_allocation_count;
+}
+
 // Helper function to parse a command line using pparser
 parser::ParseResult parse_command_line(const std::string &input, parser::ArgumentParser &parser)
 {
@@ -331,6 +379,1334 @@ void testMixedArguments()
     std::cout << "Mixed arguments test passed!\n";
 }
 
+// Test lexer checkpoints and rewinding for speculative parsing
+void testLexerCheckpointRewind()
+{
+    std::cout << "\nTesting lexer checkpoint/rewind...\n";
+    lexer::Src source = lexer::Src::from_string("name = 42 --flag");
+    lexer::Lexer lex(source);
+
+    assert(lex.lex_next().get_kind() == lexer::TokId);
+    lexer::Lexer::Checkpoint cp = lex.checkpoint();
+
+    // speculatively lex "= 42" and then back out
+    assert(lex.lex_next().get_kind() == lexer::TokAssign);
+    assert(lex.lex_next().get_kind() == lexer::TokIntLit);
+    assert(lex.get_token_count() == 3);
+    size_t capacity = lex.get_tokens().capacity();
+    lex.rewind(cp);
+    assert(lex.get_token_count() == 1);
+    assert(lex.get_tokens().capacity() == capacity);
+
+    // re-lexing after the rewind produces the same tokens
+    assert(lex.lex_next().get_kind() == lexer::TokAssign);
+    assert(lex.lex_next().get_int_value() == 42);
+    assert(lex.lex_next().get_kind() == lexer::TokFlagLong);
+    assert(lex.lex_next().get_kind() == lexer::TokEof);
+    assert(lex.is_done());
+    // eof is sticky and not appended twice
+    assert(lex.lex_next().get_kind() == lexer::TokEof);
+    assert(lex.get_token_count() == 5);
+
+    lex.rewind(cp);
+    assert(!lex.is_done());
+    assert(lex.get_token_count() == 1);
+
+    std::cout << "Lexer checkpoint/rewind test passed!\n";
+}
+
+// Test batched lexing of many inputs into one shared token arena
+void testTokenBatch()
+{
+    std::cout << "\nTesting batched lexing...\n";
+    std::vector<std::string> inputs;
+    inputs.push_back("add file1.txt -f");
+    inputs.push_back("");
+    inputs.push_back("commit -m \"unterminated");
+    inputs.push_back("--count 42");
+
+    lexer::TokenBatch batch;
+    batch.lex(inputs, 1);
+    assert(batch.size() == 4);
+    assert(batch.get_token_count(0) == 4); // add, file1.txt, -f, eof
+    assert(batch.tokens_begin(0)->get_id_value() == "add");
+    assert(batch.get_token_count(1) == 1); // eof only
+    assert(batch.has_error(2));
+    assert(batch.get_token_count(2) == 0);
+    assert(batch.get_error(2)->get_kind() == lexer::UnclosedString);
+    assert(!batch.has_error(3));
+    assert((batch.tokens_begin(3) + 1)->get_int_value() == 42);
+    // spans are relative to each input
+    assert(batch.tokens_begin(3)->get_span().start == 0);
+
+    // a large batch is split across worker threads and must match a
+    // sequential run exactly
+    std::vector<std::string> many;
+    for (size_t i = 0; i < 4 * lexer::TokenBatch::parallel_threshold; ++i) {
+        std::ostringstream line;
+        line << "cmd" << i << " --value " << i;
+        if (i % 97 == 0)
+            line << " \"bad";
+        many.push_back(line.str());
+    }
+    lexer::TokenBatch sequential;
+    sequential.lex(many, 1);
+    lexer::TokenBatch parallel;
+    parallel.lex(many, 4);
+    assert(parallel.get_tokens().size() == sequential.get_tokens().size());
+    assert(parallel.get_errors().size() == sequential.get_errors().size());
+    for (size_t i = 0; i < many.size(); ++i) {
+        assert(parallel.get_token_count(i) == sequential.get_token_count(i));
+        assert(parallel.has_error(i) == (i % 97 == 0));
+        if (!parallel.has_error(i)) {
+            assert((parallel.tokens_begin(i) + 2)->get_int_value() == (long long)i);
+        }
+    }
+
+    std::cout << "Batched lexing test passed!\n";
+}
+
+// Test dialect-specific operators added to the operator table
+void testOperatorTable()
+{
+    std::cout << "\nTesting operator table...\n";
+    lexer::Src source = lexer::Src::from_string("a => b::c 1..2 <= --");
+
+    // default table: new operators are split into their single characters
+    std::vector<lexer::Token> tokens = lexer::Lexer::tokenize(source);
+    assert(tokens[1].get_kind() == lexer::TokAssign);
+    assert(tokens[2].get_kind() == lexer::TokGreater);
+
+    lexer::OperatorTable dialect = lexer::OperatorTable::defaults();
+    dialect.add("=>", lexer::TokFatArrow)
+        .add("::", lexer::TokDoubleColon)
+        .add("..", lexer::TokDotDot);
+    tokens = lexer::Lexer::tokenize(source, dialect);
+    assert(tokens.size() == 11);
+    assert(tokens[1].get_kind() == lexer::TokFatArrow);
+    assert(tokens[3].get_kind() == lexer::TokDoubleColon);
+    assert(tokens[5].get_int_value() == 1);
+    assert(tokens[6].get_kind() == lexer::TokDotDot);
+    assert(tokens[7].get_int_value() == 2);
+    assert(tokens[8].get_kind() == lexer::TokLessEq);
+    assert(tokens[9].get_kind() == lexer::TokDoubleMinus);
+
+    std::cout << "Operator table test passed!\n";
+}
+
+// Test filtering token kinds in the lexer
+void testKindFilter()
+{
+    std::cout << "\nTesting token kind filter...\n";
+    lexer::Src source = lexer::Src::from_string(
+        "if x == 99999999999999999999 { print \"hi\" 1.5 }");
+    lexer::KindMask keep = lexer::kind_bit(lexer::TokId) | lexer::kind_bit(lexer::TokStrLit);
+
+    // the out-of-range literal is filtered out, so it is never converted
+    std::vector<lexer::Token> tokens = lexer::Lexer::tokenize(source, keep);
+    assert(tokens.size() == 3);
+    assert(tokens[0].get_id_value() == "x");
+    assert(tokens[1].get_id_value() == "print");
+    assert(tokens[2].get_str_lit_value() == "hi");
+
+    // token-at-a-time lexing skips filtered kinds and still reports eof
+    lexer::Lexer lex(source);
+    lex.set_kind_filter(keep);
+    assert(lex.lex_next().get_id_value() == "x");
+    assert(lex.lex_next().get_id_value() == "print");
+    assert(lex.lex_next().get_kind() == lexer::TokStrLit);
+    assert(lex.lex_next().get_kind() == lexer::TokEof);
+    assert(lex.get_token_count() == 3);
+
+    std::cout << "Token kind filter test passed!\n";
+}
+
+// Test the persistent token cache (uses the working directory)
+void testTokenCache()
+{
+    std::cout << "\nTesting token cache...\n";
+    char dir[] = "/tmp/lexer_token_cache_XXXXXX";
+    assert(mkdtemp(dir) != NULL);
+    lexer::TokenCache cache(dir);
+    lexer::Src source = lexer::Src::from_string(
+        "run --name \"a\\tb\" -x 0x1f 2.5e3 // comment\nstop");
+    cache.invalidate(source);
+
+    std::vector<lexer::Token> cached;
+    assert(!cache.load(source, cached));
+    std::vector<lexer::Token> tokens = cache.tokenize(source); // miss: lex + store
+    assert(cache.load(source, cached));
+    assert(cached.size() == tokens.size());
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        std::ostringstream a, b;
+        a << tokens[i];
+        b << cached[i];
+        assert(a.str() == b.str());
+        assert(cached[i].get_span().start == tokens[i].get_span().start);
+        assert(cached[i].get_span().end == tokens[i].get_span().end);
+    }
+    // string refs point back into the source buffer
+    assert(cached[2].get_string_ref_start() == tokens[2].get_string_ref_start());
+    assert(cached[2].get_str_lit_value() == "a\tb");
+    assert(cached[4].get_int_value() == 0x1f);
+    assert(cached[4].get_int_base() == lexer::Hex);
+    assert(cached[5].get_float_value() == 2500.0);
+    assert(cached[5].has_float_exponent());
+
+    // a different source content misses
+    lexer::Src other = lexer::Src::from_string("run --name other");
+    assert(!cache.load(other, cached));
+
+    // a corrupted entry is rejected, whether a span or a payload changed
+    std::string path = cache.get_entry_path(source);
+    {
+        std::fstream file(path.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(lexer::TokenCache::header_size + 8);
+        file.put('\x7f');
+    }
+    std::vector<lexer::Token> rejected;
+    assert(!cache.load(source, rejected));
+    assert(rejected.empty());
+    cache.store(source, tokens);
+    {
+        // low byte of the 0x1f int literal (record 4)
+        std::fstream file(path.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(lexer::TokenCache::header_size + 4 * lexer::TokenCache::record_size + 24);
+        file.put('\x05');
+    }
+    assert(!cache.load(source, rejected));
+    assert(rejected.empty());
+
+    // a cache that cannot be written still returns the lexed tokens
+    lexer::TokenCache missing(std::string(dir) + "/missing");
+    assert(missing.tokenize(source).size() == tokens.size());
+
+    // loading into a vector reuses its storage
+    cache.store(source, tokens);
+    const lexer::Token *storage = &cached[0];
+    assert(cache.load(source, cached));
+    assert(&cached[0] == storage && cached.size() == tokens.size());
+
+    assert(cache.invalidate(source));
+    assert(!cache.invalidate(source));
+    assert(!cache.load(source, cached));
+    // no temporary files are left behind
+    assert(rmdir(dir) == 0);
+
+    std::cout << "Token cache test passed!\n";
+}
+
+// stream buffer that hands out some input and then fails
+class FailingBuf : public std::streambuf
+{
+public:
+    explicit FailingBuf(const std::string &data) : m_data(data)
+    {
+        setg(&m_data[0], &m_data[0], &m_data[0] + m_data.size());
+    }
+
+protected:
+    int_type underflow()
+    {
+        throw std::runtime_error("device error");
+    }
+
+private:
+    std::string m_data;
+};
+
+// Test streaming lexing with tokens crossing chunk boundaries
+void testStreamLexer()
+{
+    std::cout << "\nTesting stream lexer...\n";
+    std::string input;
+    for (int i = 0; i < 50; ++i) {
+        std::ostringstream line;
+        line << "cmd" << i << " --long-flag-name " << i * 12345 << " 1.5e3 "
+             << "\"quoted value " << i << "\" // trailing comment\n";
+        input += line.str();
+    }
+    lexer::Src whole = lexer::Src::from_string(input);
+    std::vector<lexer::Token> expected = lexer::Lexer::tokenize(whole);
+
+    // a tiny chunk size forces most tokens across a chunk boundary
+    std::istringstream in(input);
+    lexer::StreamLexer stream(in, "<stdin>", 7);
+    std::vector<lexer::Token> chunk;
+    size_t index = 0;
+    while (stream.next_tokens(chunk)) {
+        for (size_t i = 0; i < chunk.size(); ++i, ++index) {
+            assert(index < expected.size());
+            std::ostringstream a, b;
+            a << expected[index];
+            b << chunk[i];
+            assert(a.str() == b.str());
+            assert(chunk[i].get_span().start == expected[index].get_span().start);
+            assert(chunk[i].get_span().end == expected[index].get_span().end);
+        }
+    }
+    assert(index == expected.size());
+
+    // without read-ahead the stream is only read by next_tokens()
+    std::istringstream lazy_in(input);
+    lexer::StreamLexer lazy(lazy_in, "<stdin>", 7, false);
+    assert(lazy_in.tellg() == 0);
+    index = 0;
+    while (lazy.next_tokens(chunk)) {
+        for (size_t i = 0; i < chunk.size(); ++i, ++index) {
+            assert(chunk[i].get_kind() == expected[index].get_kind());
+            assert(chunk[i].get_span().start == expected[index].get_span().start);
+        }
+    }
+    assert(index == expected.size());
+
+    // a long comment is dropped as it is read, not carried from window to
+    // window
+    std::string commented = "first // " + std::string(100000, 'c') + "\nsecond";
+    std::istringstream comment_in(commented);
+    lexer::StreamLexer comment_stream(comment_in, "<stdin>", 16);
+    std::vector<std::string> words;
+    while (comment_stream.next_tokens(chunk)) {
+        for (size_t i = 0; i < chunk.size(); ++i) {
+            if (chunk[i].get_kind() == lexer::TokId) {
+                words.push_back(std::string(chunk[i].get_string_ref_start(), chunk[i].get_string_ref_length()));
+            }
+        }
+    }
+    assert(words.size() == 2 && words[0] == "first" && words[1] == "second");
+    assert(comment_stream.get_buffer_size() <= 4 * 16);
+
+    // errors report the location within the whole stream
+    std::istringstream bad("ok\nfine\n  @");
+    lexer::StreamLexer bad_stream(bad, "<stdin>", 4);
+    bool threw = false;
+    try {
+        while (bad_stream.next_tokens(chunk)) {
+        }
+    } catch (const lexer::LexError &e) {
+        threw = true;
+        assert(e.get_location().get_line() == 3);
+        assert(e.get_location().get_col() == 3);
+    }
+    assert(threw);
+
+    // a failing read is reported to the consumer, not lost on the reader
+    FailingBuf failing_buf("run --name value --other ");
+    std::istream failing(&failing_buf);
+    failing.exceptions(std::ios::badbit);
+    threw = false;
+    try {
+        lexer::StreamLexer failing_stream(failing, "<stdin>", 8);
+        while (failing_stream.next_tokens(chunk)) {
+        }
+    } catch (const std::runtime_error &e) {
+        threw = std::string(e.what()) == "device error";
+    }
+    assert(threw);
+
+    // unseekable input can still be read whole
+    std::istringstream pipe_like("a b c");
+    lexer::Src piped = lexer::Src::from_stream(pipe_like);
+    assert(lexer::Lexer::tokenize(piped).size() == 4);
+
+    std::cout << "Stream lexer test passed!\n";
+}
+
+// Test indexed flag lookup on a command with many options
+void testIndexedFlagLookup()
+{
+    std::cout << "\nTesting indexed flag lookup...\n";
+    parser::ArgumentParser parser("test", "Test CLI parser");
+    parser::Command &root = parser.get_root_command();
+    for (int i = 0; i < 300; ++i) {
+        std::ostringstream name, alias;
+        name << "opt" << i;
+        alias << "--option-" << i;
+        root.add_keyword_arg(name.str(), parser::make_aliases(alias.str().c_str()), "generated option", parser::ArgType_Single);
+    }
+    root.add_keyword_arg("color", parser::make_aliases("-c"), "colored output", parser::ArgType_Flag, false, parser::ArgValue(true));
+    parser.freeze();
+
+    parser::ParseResult result = parse_command_line("--opt7 a --option-299 b --no-color", parser);
+    assert(result.status == parser::ParseResult::ParserStatus_Success);
+    assert(result.find_kw_arg_string("opt7") == "a");
+    assert(result.find_kw_arg_string("opt299") == "b");
+    assert(result.find_kw_arg_bool("no_color") == true);
+
+    result = parse_command_line("--option-300 x", parser);
+    assert(result.status == parser::ParseResult::ParserStatus_ParseError);
+
+    // a frozen schema is read-only
+    bool threw = false;
+    try {
+        root.add_keyword_arg("late", parser::make_aliases("-l", "--late"), "added later", parser::ArgType_Flag);
+    } catch (const std::logic_error &) {
+        threw = true;
+    }
+    assert(threw);
+
+    // schema changes of an unfrozen parser are picked up by the next parse
+    parser::ArgumentParser open_parser("open", "Test CLI parser");
+    parser::Command &open_root = open_parser.get_root_command();
+    open_root.add_keyword_arg("early", parser::make_aliases("-e"), "added first", parser::ArgType_Flag);
+    result = parse_command_line("-e", open_parser);
+    assert(result.status == parser::ParseResult::ParserStatus_Success);
+    open_root.add_keyword_arg("late", parser::make_aliases("-l", "--late"), "added later", parser::ArgType_Flag);
+    result = parse_command_line("-l", open_parser);
+    assert(result.status == parser::ParseResult::ParserStatus_Success);
+    assert(result.find_kw_arg_bool("late") == true);
+
+    // Command::parse builds the indexes of a never-frozen command itself,
+    // and rebuilds them after a change
+    parser::Command plain("plain", "never frozen");
+    plain.add_keyword_arg("flag", parser::make_aliases("-f"), "flag", parser::ArgType_Flag);
+    lexer::Src flag_source = lexer::Src::from_string("-f");
+    std::vector<lexer::Token> tokens = lexer::Lexer::tokenize(flag_source);
+    tokens.pop_back(); // TokEof
+    size_t index = 0;
+    result = plain.parse(tokens, index, "");
+    assert(result.status == parser::ParseResult::ParserStatus_Success);
+    assert(result.find_kw_arg_bool("flag") == true);
+    open_root.add_keyword_arg("later", parser::make_aliases("-L"), "added last", parser::ArgType_Flag);
+    lexer::Src source = lexer::Src::from_string("-L");
+    tokens = lexer::Lexer::tokenize(source);
+    tokens.pop_back();
+    index = 0;
+    result = open_root.parse(tokens, index, "");
+    assert(result.status == parser::ParseResult::ParserStatus_Success);
+    assert(result.find_kw_arg_bool("later") == true);
+
+    // building other parsers leaves a frozen parser's indexes alone
+    parser::ArgumentParser other("other", "Test CLI parser");
+    other.get_root_command().add_keyword_arg("x", parser::make_aliases("-x"), "x", parser::ArgType_Flag);
+    lexer::Src color_source = lexer::Src::from_string("-c");
+    tokens = lexer::Lexer::tokenize(color_source);
+    tokens.pop_back();
+    index = 0;
+    result = root.parse(tokens, index, "");
+    assert(result.status == parser::ParseResult::ParserStatus_Success);
+
+    std::cout << "Indexed flag lookup test passed!\n";
+}
+
+void testCombinedShortFlags()
+{
+    std::cout << "\nTesting combined short flags...\n";
+    parser::ArgumentParser parser("test", "Test CLI parser");
+    parser::Command &root = parser.get_root_command();
+    root.add_keyword_arg("extract", parser::make_aliases("-x"), "extract", parser::ArgType_Flag);
+    root.add_keyword_arg("verbose", parser::make_aliases("-v"), "verbose", parser::ArgType_Flag);
+    root.add_keyword_arg("gzip", parser::make_aliases("-z"), "gzip", parser::ArgType_Flag);
+    root.add_keyword_arg("file", parser::make_aliases("-f"), "archive file", parser::ArgType_Single);
+
+    parser::ParseResult result = parse_command_line("-xvz", parser);
+    assert(result.status == parser::ParseResult::ParserStatus_Success);
+    assert(result.find_kw_arg_bool("extract") == true);
+    assert(result.find_kw_arg_bool("verbose") == true);
+    assert(result.find_kw_arg_bool("gzip") == true);
+
+    // value-taking flags cannot be combined
+    result = parse_command_line("-xvf archive.tar", parser);
+    assert(result.status == parser::ParseResult::ParserStatus_ParseError);
+
+    result = parse_command_line("-xq", parser);
+    assert(result.status == parser::ParseResult::ParserStatus_ParseError);
+
+    result = parse_command_line("-xh", parser);
+    assert(result.status == parser::ParseResult::ParserStatus_HelpRequested);
+
+    std::cout << "Combined short flags test passed!\n";
+}
+
+void testHashedSubcommandDispatch()
+{
+    std::cout << "\nTesting hashed subcommand dispatch...\n";
+    parser::ArgumentParser parser("test", "Test CLI parser");
+    parser::Command &root = parser.get_root_command();
+    for (int i = 0; i < 500; ++i) {
+        std::ostringstream name, alias;
+        name << "resource" << i;
+        alias << "r" << i;
+        parser::command_ptr cmd(new parser::Command(name.str(), "generated command"));
+        cmd->add_alias(alias.str());
+        root.add_command(cmd);
+    }
+    parser.freeze();
+
+    parser::ParseResult result = parse_command_line("resource42", parser);
+    assert(result.status == parser::ParseResult::ParserStatus_Success);
+    assert(result.command_path == "test resource42");
+    result = parse_command_line("r499", parser);
+    assert(result.status == parser::ParseResult::ParserStatus_Success);
+    assert(result.command_path == "test resource499");
+
+    // frozen subcommands refuse new aliases
+    bool threw = false;
+    try {
+        root.get_commands().find("resource1")->second->add_alias("dup");
+    } catch (const std::logic_error &) {
+        threw = true;
+    }
+    assert(threw);
+
+    // an alias added to two children after registration is ambiguous
+    parser::ArgumentParser open_parser("test", "Test CLI parser");
+    parser::Command &open_root = open_parser.get_root_command();
+    parser::command_ptr first(new parser::Command("first", "generated command"));
+    parser::command_ptr second(new parser::Command("second", "generated command"));
+    open_root.add_command(first);
+    open_root.add_command(second);
+    result = parse_command_line("first", open_parser);
+    assert(result.status == parser::ParseResult::ParserStatus_Success);
+    // a child's new alias is picked up by the parent's next parse
+    first->add_alias("f");
+    result = parse_command_line("f", open_parser);
+    assert(result.status == parser::ParseResult::ParserStatus_Success);
+    assert(result.command_path == "test first");
+    first->add_alias("dup");
+    second->add_alias("dup");
+    result = parse_command_line("dup", open_parser);
+    assert(result.status == parser::ParseResult::ParserStatus_ParseError);
+    assert(result.error_message.find("ambiguous") != std::string::npos);
+    threw = false;
+    try {
+        open_parser.freeze();
+    } catch (const std::invalid_argument &) {
+        threw = true;
+    }
+    assert(threw);
+    result = parse_command_line("dup", open_parser);
+    assert(result.status == parser::ParseResult::ParserStatus_ParseError);
+
+    std::cout << "Hashed subcommand dispatch test passed!\n";
+}
+
+void testSlotIndexedResult()
+{
+    std::cout << "\nTesting slot-indexed parse results...\n";
+    parser::ArgumentParser parser("test", "Test CLI parser");
+    parser::Command &root = parser.get_root_command();
+    root.add_keyword_arg("level", parser::make_aliases("-l", "--level"), "level", parser::ArgType_Single, false, parser::ArgValue((long long)3));
+    root.add_keyword_arg("quiet", parser::make_aliases("-q"), "quiet", parser::ArgType_Flag);
+    root.add_positional_arg("input", "input file");
+    root.add_positional_arg("output", "output file", parser::ArgType_Single, false, parser::ArgValue(std::string("out.txt")));
+
+    parser::ParseResult result = parse_command_line("-q source", parser);
+    assert(result.status == parser::ParseResult::ParserStatus_Success);
+
+    size_t level_slot = root.get_keyword_slot("level");
+    size_t quiet_slot = root.get_keyword_slot("quiet");
+    assert(level_slot != parser::SlotTable::npos && quiet_slot != parser::SlotTable::npos);
+    assert(root.get_keyword_slot("missing") == parser::SlotTable::npos);
+    assert(result.was_kw_slot_given(quiet_slot));
+    assert(!result.was_kw_slot_given(level_slot));
+    assert(*result.get_kw_slot_value(level_slot)->get_int() == 3);
+
+    size_t output_slot = root.get_positional_slot("output");
+    assert(*result.get_pos_slot_value(root.get_positional_slot("input"))->get_string() == "source");
+    assert(*result.get_pos_slot_value(output_slot)->get_string() == "out.txt");
+
+    // the string-keyed getters go through the same slots
+    assert(result.has_kw_arg("level"));
+    assert(!result.has_kw_arg("help"));
+    assert(result.find_kw_arg_int("level") == 3);
+    assert(result.find_kw_arg_bool("quiet") == true);
+    assert(result.find_pos_arg_string("output") == "out.txt");
+
+    std::cout << "Slot-indexed parse results test passed!\n";
+}
+
+void testTypedArgHandles()
+{
+    std::cout << "\nTesting typed argument handles...\n";
+    parser::ArgumentParser parser("test", "Test CLI parser");
+    parser::Command &root = parser.get_root_command();
+    parser::ArgHandle<bool> force = root.add_typed_keyword_arg<bool>("force", parser::make_aliases("-f"), "force");
+    parser::ArgHandle<long long> jobs = root.add_typed_keyword_arg<long long>("jobs", parser::make_aliases("-j"), "jobs", false, 4LL);
+    parser::ArgHandle<double> ratio = root.add_typed_keyword_arg<double>("ratio", parser::make_aliases("-r"), "ratio");
+    parser::ArgHandle<std::vector<std::string> > tags = root.add_typed_keyword_arg<std::vector<std::string> >("tags", parser::make_aliases("-t"), "tags");
+    parser::ArgHandle<std::string> target = root.add_typed_positional_arg<std::string>("target", "build target");
+
+    parser::ParseResult result = parse_command_line("all -f -r 0.5 -t a b", parser);
+    assert(result.status == parser::ParseResult::ParserStatus_Success);
+    assert(force.find(result) == true);
+    assert(force.was_given(result));
+    assert(jobs.find(result) == 4);
+    assert(!jobs.was_given(result));
+    assert(ratio.get(result) && *ratio.get(result) == 0.5);
+    assert(tags.find(result).size() == 2 && tags.find(result)[1] == "b");
+    assert(target.find(result) == "all");
+
+    // a handle only reads results produced by its own command
+    parser::ArgumentParser other("other", "Other CLI parser");
+    parser::ParseResult other_result = parse_command_line("", other);
+    assert(force.get(other_result) == nullptr);
+    assert(force.find(other_result) == false);
+
+    std::cout << "Typed argument handles test passed!\n";
+}
+
+void testArgValueStorage()
+{
+    std::cout << "\nTesting ArgValue string storage...\n";
+    // every string value is a std::string; short ones need no allocation
+    parser::ArgValue empty;
+    parser::ArgValue small(std::string("json"));
+    struct Assign
+    {
+        parser::ArgValue *to;
+        const parser::ArgValue *from;
+        void operator()() const { *to = *from; }
+    };
+    Assign assign = {&empty, &small};
+    assert(count_allocations(assign) == 0);
+    assert(empty.get_string() && *empty.get_string() == "json");
+    assert(small.get_string_unsafe().size() == 4);
+    assert(small.get_string_ptr_unsafe() == small.get_string());
+    assert(small.get_string_ref().length == 4);
+    assert(small.get_string_value() == "json");
+
+    std::string long_text(40, 'x');
+    parser::ArgValue large(long_text);
+    assert(*large.get_string() == long_text);
+
+    // string literals are strings, not booleans
+    parser::ArgValue literal("true");
+    assert(literal.is_string() && literal.get_string_value() == "true");
+
+    parser::ArgValue large_copy(large);
+    assert(*large_copy.get_string() == long_text);
+    assert(large_copy.get_string()->data() != large.get_string()->data());
+
+    // swap moves the characters without copying them, also between a
+    // string and a non-string value
+    const char *large_data = large_copy.get_string()->data();
+    parser::ArgValue number((long long)7);
+    large_copy.swap(number);
+    assert(number.get_string()->data() == large_data);
+    assert(*large_copy.get_int() == 7);
+    number.swap(small);
+    assert(small.get_string()->data() == large_data);
+    assert(*number.get_string() == "json");
+
+    // set_string reuses the string's capacity
+    const char *small_data = small.get_string()->data();
+    small.set_string("other", 5);
+    assert(small.get_string()->data() == small_data && *small.get_string() == "other");
+
+    // parsed strings and defaults are read through get_string()
+    parser::ArgumentParser parser("test", "Test CLI parser");
+    parser::Command &root = parser.get_root_command();
+    root.add_keyword_arg("name", parser::make_aliases("-n"), "name", parser::ArgType_Single, false, parser::ArgValue("anon"));
+    root.add_keyword_arg("mode", parser::make_aliases("-m"), "mode", parser::ArgType_Single);
+    std::vector<std::string> modes;
+    modes.push_back("fast");
+    modes.push_back("slow");
+    root.set_choices("mode", modes);
+    parser.freeze();
+    parser::ParseResult result = parser.parse("-n bob -m slow");
+    assert(*result.get_kw_arg_string("name") == "bob");
+    assert(*result.get_kw_arg_string("mode") == "slow");
+    assert(result.get_kw_arg_string_ref("name").to_string() == "bob");
+    result = parser.parse("");
+    assert(*result.get_kw_arg_string("name") == "anon"); // default
+
+    std::cout << "ArgValue string storage test passed!\n";
+}
+
+void testArgvParsing()
+{
+    std::cout << "\nTesting argv parsing...\n";
+    parser::ArgumentParser parser("test", "Test CLI parser");
+    parser::Command &root = parser.get_root_command();
+    root.add_keyword_arg("output", parser::make_aliases("-o", "--output"), "output file", parser::ArgType_Single);
+    root.add_keyword_arg("verbose", parser::make_aliases("-v"), "verbose", parser::ArgType_Flag);
+    root.add_positional_arg("files", "input files", parser::ArgType_Multiple);
+
+    char arg0[] = "test", arg1[] = "--output", arg2[] = "'out dir'", arg3[] = "-v", arg4[] = "a.txt", arg5[] = "b.txt";
+    char *argv[] = { arg0, arg1, arg2, arg3, arg4, arg5 };
+
+    // tokens are built over argv itself
+    std::vector<lexer::Token> tokens;
+    parser::ArgumentParser::tokenize_argv(6, argv, tokens);
+    assert(tokens.size() == 5);
+    assert(tokens[0].get_kind() == lexer::TokFlagLong && tokens[0].get_string_ref_start() == arg1 + 2);
+    assert(tokens[1].get_kind() == lexer::TokStrLit && tokens[1].get_string_ref_start() == arg2 + 1);
+    assert(tokens[1].get_string_ref_length() == 7);
+    assert(tokens[2].get_kind() == lexer::TokFlagShort);
+    assert(tokens[3].get_kind() == lexer::TokId && tokens[3].get_string_ref_start() == arg4);
+
+    parser::ParseResult result = parser.parse(6, argv);
+    assert(result.status == parser::ParseResult::ParserStatus_Success);
+    assert(result.find_kw_arg_string("output") == "out dir");
+    assert(result.find_kw_arg_bool("verbose") == true);
+    assert(result.find_pos_arg_list("files").size() == 2);
+
+    std::cout << "Argv parsing test passed!\n";
+}
+
+void testFusedArgvParsing()
+{
+    std::cout << "\nTesting fused argv parsing...\n";
+    parser::ArgumentParser parser("tool", "Test CLI parser");
+    parser::Command &root = parser.get_root_command();
+    root.add_keyword_arg("verbose", parser::make_aliases("-v"), "verbose", parser::ArgType_Flag);
+    root.add_keyword_arg("quiet", parser::make_aliases("-q"), "quiet", parser::ArgType_Flag);
+    parser::command_ptr copy_cmd(new parser::Command("copy", "copy files"));
+    copy_cmd->add_alias("cp");
+    copy_cmd->add_keyword_arg("mode", parser::make_aliases("-m", "--mode"), "mode", parser::ArgType_Single);
+    copy_cmd->add_keyword_arg("exclude", parser::make_aliases("-x"), "excludes", parser::ArgType_Multiple);
+    copy_cmd->add_positional_arg("source", "source");
+    copy_cmd->add_positional_arg("dest", "destination", parser::ArgType_Single, false, parser::ArgValue("."));
+    root.add_command(copy_cmd);
+    parser.freeze();
+
+    struct Case { int argc; const char *argv[7]; };
+    const Case cases[] = {
+        { 7, { "tool", "-vq", "cp", "--mode", "'fast'", "a", "b" } },
+        { 6, { "tool", "copy", "src", "-x", "one", "two" } },
+        { 3, { "tool", "copy", "-m" } },
+        { 6, { "tool", "-v", "copy", "src", "dst", "extra" } },
+    };
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); ++c) {
+        int argc = cases[c].argc;
+        std::vector<std::string> storage(cases[c].argv, cases[c].argv + argc);
+        std::vector<char *> argv;
+        for (int i = 0; i < argc; ++i) argv.push_back(&storage[i][0]);
+
+        // reference: tokenize everything first, then parse the token vector
+        std::vector<lexer::Token> tokens;
+        parser::ArgumentParser::tokenize_argv(argc, &argv[0], tokens);
+        size_t expected_index = 0;
+        parser::ParseResult expected = root.parse(tokens, expected_index, "");
+
+        parser::ArgvCursor cursor(argc, &argv[0]);
+        size_t fused_index = 0;
+        parser::ParseResult fused = root.parse_cursor(cursor, fused_index, "");
+
+        assert(fused.status == expected.status);
+        assert(fused_index == expected_index);
+        assert(fused.command_path == expected.command_path);
+        assert(fused.error_message == expected.error_message);
+        assert(fused.find_kw_arg_string("mode") == expected.find_kw_arg_string("mode"));
+        assert(fused.find_kw_arg_list("exclude") == expected.find_kw_arg_list("exclude"));
+        assert(fused.find_pos_arg_string("dest") == expected.find_pos_arg_string("dest"));
+    }
+
+    std::cout << "Fused argv parsing test passed!\n";
+}
+
+void testParseIntoReuse()
+{
+    std::cout << "\nTesting parse_into result reuse...\n";
+    parser::ArgumentParser parser("tool", "Test CLI parser");
+    parser::Command &root = parser.get_root_command();
+    root.add_keyword_arg("level", parser::make_aliases("-l"), "level", parser::ArgType_Single);
+    parser::command_ptr run_cmd(new parser::Command("run", "run a target"));
+    run_cmd->add_positional_arg("target", "target");
+    run_cmd->add_keyword_arg("name", parser::make_aliases("-n"), "name", parser::ArgType_Single, false, parser::ArgValue("default"));
+    root.add_command(run_cmd);
+
+    parser::ParseResult result;
+    parser.parse_into("-l 2 run build -n fast", result);
+    assert(result.status == parser::ParseResult::ParserStatus_Success);
+    assert(result.command_path == "tool run");
+    assert(result.find_kw_arg_string("name") == "fast");
+    const parser::ArgValue *slots = &result.keyword_slots[0];
+
+    // a second parse starts from a clean state but keeps the storage
+    parser.parse_into("run test", result);
+    assert(result.status == parser::ParseResult::ParserStatus_Success);
+    assert(result.command_path == "tool run");
+    assert(result.find_kw_arg_string("name") == "default");
+    assert(result.find_pos_arg_string("target") == "test");
+    assert(&result.keyword_slots[0] == slots);
+
+    parser.parse_into("-l", result);
+    assert(result.status == parser::ParseResult::ParserStatus_ParseError);
+    assert(result.command_path == "tool");
+    parser.parse_into("run again", result);
+    assert(result.status == parser::ParseResult::ParserStatus_Success);
+    assert(result.error_message.empty());
+
+    // once warm, lexing and parsing a line allocates nothing
+    const std::string line("-l 3 run deploy -n quick");
+    struct Reparse
+    {
+        parser::ArgumentParser *parser;
+        parser::ParseResult *result;
+        const std::string *line;
+        void operator()() const { parser->parse_into(*line, *result); }
+    };
+    Reparse reparse = {&parser, &result, &line};
+    reparse();
+    assert(count_allocations(reparse) == 0);
+    assert(result.find_pos_arg_string("target") == "deploy");
+    assert(result.find_kw_arg_string("name") == "quick");
+
+    // a caller-owned scratch leaves the parser's own buffers alone, so
+    // several threads can share one frozen parser
+    parser.freeze();
+    parser::ParseScratch scratch;
+    parser::ParseResult other;
+    parser.parse_into("run other -n slow", other, scratch);
+    assert(other.status == parser::ParseResult::ParserStatus_Success);
+    assert(other.find_pos_arg_string("target") == "other");
+    assert(result.find_pos_arg_string("target") == "deploy");
+    const char *argv[] = {"tool", "run", "argv-target"};
+    parser.parse_into(3, const_cast<char **>(argv), other, scratch);
+    assert(other.find_pos_arg_string("target") == "argv-target");
+
+    std::cout << "parse_into result reuse test passed!\n";
+}
+
+void testLazyDefaults()
+{
+    std::cout << "\nTesting lazily resolved defaults...\n";
+    parser::ArgumentParser parser("test", "Test CLI parser");
+    parser::Command &root = parser.get_root_command();
+    std::vector<std::string> default_paths;
+    default_paths.push_back("/usr/include");
+    root.add_keyword_arg("include", parser::make_aliases("-I"), "include paths", parser::ArgType_Multiple, false, parser::ArgValue(default_paths));
+    root.add_keyword_arg("jobs", parser::make_aliases("-j"), "jobs", parser::ArgType_Single, false, parser::ArgValue((long long)8));
+    root.add_keyword_arg("name", parser::make_aliases("-n"), "name", parser::ArgType_Single);
+    root.add_positional_arg("mode", "mode", parser::ArgType_Single, false, parser::ArgValue("debug"));
+
+    parser::ParseResult result;
+    parser.parse_into("-I a b", result);
+    assert(result.status == parser::ParseResult::ParserStatus_Success);
+    // values given for a list option append to its default
+    std::vector<std::string> includes = result.find_kw_arg_list("include");
+    assert(includes.size() == 3 && includes[0] == "/usr/include" && includes[2] == "b");
+    assert(*result.get_kw_arg_int("jobs") == 8);
+    assert(result.has_kw_arg("name") && result.get_kw_arg_string("name") == nullptr);
+    assert(result.has_pos_arg("mode") && result.find_pos_arg_string("mode") == "debug");
+
+    // a reused result does not leak values from the previous parse
+    parser.parse_into("-j 2 release", result);
+    assert(result.status == parser::ParseResult::ParserStatus_Success);
+    assert(result.find_kw_arg_list("include").size() == 1);
+    assert(result.find_kw_arg_int("jobs") == 2);
+    assert(result.find_pos_arg_string("mode") == "release");
+
+    std::cout << "Lazily resolved defaults test passed!\n";
+}
+
+void testLazyValues()
+{
+    std::cout << "\nTesting lazy value materialization...\n";
+    parser::ArgumentParser parser("test", "Test CLI parser");
+    parser::Command &root = parser.get_root_command();
+    root.add_keyword_arg("count", parser::make_aliases("-c"), "count", parser::ArgType_Single);
+    root.add_keyword_arg("label", parser::make_aliases("-l"), "label", parser::ArgType_Single);
+    parser::ArgHandle<std::string> target = root.add_typed_positional_arg<std::string>("target", "target");
+
+    parser::ParseResult result;
+    result.set_lazy_values(true);
+    const std::string line = "-c 42 -l \"two words\" build";
+    parser.parse_into(line, result);
+    assert(result.status == parser::ParseResult::ParserStatus_Success);
+
+    // values stay as tokens until first read
+    size_t count_slot = root.get_keyword_slot("count");
+    assert(result.keyword_pending.test(count_slot));
+    assert(result.find_kw_arg_int("count") == 42);
+    assert(!result.keyword_pending.test(count_slot));
+    assert(result.find_kw_arg_string("label") == "two words");
+    assert(target.find(result) == "build");
+
+    // invalid values are still rejected at parse time
+    const std::string bad_line = "-c + build";
+    parser.parse_into(bad_line, result);
+    assert(result.status == parser::ParseResult::ParserStatus_ParseError);
+
+    std::cout << "Lazy value materialization test passed!\n";
+}
+
+void testNumericLists()
+{
+    std::cout << "\nTesting typed numeric lists...\n";
+    parser::ArgumentParser parser("test", "Test CLI parser");
+    parser::Command &root = parser.get_root_command();
+    parser::ArgHandle<std::vector<long long> > ids =
+        root.add_typed_keyword_arg<std::vector<long long> >("ids", parser::make_aliases("-i", "--ids"), "ids");
+    root.add_keyword_arg("scale", parser::make_aliases("-s", "--scale"), "scale", parser::ArgType_MultipleDouble);
+    root.add_keyword_arg("verbose", parser::make_aliases("-v"), "verbose", parser::ArgType_Flag);
+    root.add_positional_arg("points", "points", parser::ArgType_MultipleDouble);
+
+    // literals convert directly; "-2" reads as a negative number
+    parser::ParseResult result = parser.parse("--ids 1 -2 3 -s 0.5 2 -v 1.5 -4.25");
+    assert(result.status == parser::ParseResult::ParserStatus_Success);
+    const std::vector<long long> *id_values = ids.get(result);
+    assert(id_values && id_values->size() == 3);
+    assert((*id_values)[0] == 1 && (*id_values)[1] == -2 && (*id_values)[2] == 3);
+    parser::ValueSpan<double> scale = result.find_kw_arg_double_span("scale");
+    assert(scale.size() == 2 && scale[0] == 0.5 && scale[1] == 2.0);
+    assert(result.find_kw_arg_bool("verbose"));
+    const std::vector<double> *points = result.get_pos_arg_double_list("points");
+    assert(points && points->size() == 2);
+    assert((*points)[0] == 1.5 && (*points)[1] == -4.25);
+
+    // argv text is parsed in place
+    const char *argv[] = {"test", "-i", "7", "-8", "--scale", "1e3", "-v", "3"};
+    result = parser.parse(8, const_cast<char **>(argv));
+    assert(result.status == parser::ParseResult::ParserStatus_Success);
+    parser::ValueSpan<long long> id_span = result.find_kw_arg_int_span("ids");
+    assert(id_span.size() == 2 && id_span[0] == 7 && id_span[1] == -8);
+    assert(result.find_kw_arg_double_span("scale")[0] == 1000.0);
+    assert(result.find_pos_arg_double_span("points").size() == 1);
+
+    // a reused result refills the same list buffers in place
+    parser::ParseResult reused;
+    const char *short_argv[] = {"test", "-i", "5", "-v", "9", "-s", "0.25"};
+    parser.parse_into(8, const_cast<char **>(argv), reused);
+    const long long *id_data = &(*ids.get(reused))[0];
+    const double *point_data = &(*reused.get_pos_arg_double_list("points"))[0];
+    struct Reparse
+    {
+        parser::ArgumentParser *parser;
+        parser::ParseResult *result;
+        const char **argv;
+        void operator()() const { parser->parse_into(7, const_cast<char **>(argv), *result); }
+    };
+    Reparse reparse = {&parser, &reused, short_argv};
+    assert(count_allocations(reparse) == 0);
+    assert(reused.status == parser::ParseResult::ParserStatus_Success);
+    assert(ids.get(reused)->size() == 1 && &(*ids.get(reused))[0] == id_data);
+    assert((*ids.get(reused))[0] == 5);
+    assert(reused.find_pos_arg_double_span("points")[0] == 9.0);
+    assert(&(*reused.get_pos_arg_double_list("points"))[0] == point_data);
+
+    // non-numeric values are rejected
+    result = parser.parse("--ids abc");
+    assert(result.status == parser::ParseResult::ParserStatus_ParseError);
+    result = parser.parse("--ids");
+    assert(result.status == parser::ParseResult::ParserStatus_ParseError);
+
+    std::cout << "Typed numeric lists test passed!\n";
+}
+
+static void collectSinkValue(const lexer::StringRef &value, void *context)
+{
+    static_cast<std::vector<std::string> *>(context)->push_back(value.to_string());
+}
+
+void testPositionalSink()
+{
+    std::cout << "\nTesting streamed positional lists...\n";
+    parser::ArgumentParser parser("test", "Test CLI parser");
+    parser::Command &root = parser.get_root_command();
+    root.add_keyword_arg("verbose", parser::make_aliases("-v"), "verbose", parser::ArgType_Flag);
+    root.add_positional_arg("files", "files", parser::ArgType_Multiple);
+
+    std::vector<std::string> seen;
+    root.set_positional_sink("files", collectSinkValue, &seen);
+
+    // values reach the sink in order and nothing is stored
+    parser::ParseResult result = parser.parse("alpha \"two words\" \"tab\\tx\" -v");
+    assert(result.status == parser::ParseResult::ParserStatus_Success);
+    assert(seen.size() == 3);
+    assert(seen[0] == "alpha" && seen[1] == "two words" && seen[2] == "tab\tx");
+    assert(result.has_pos_arg("files"));
+    assert(result.get_pos_arg_list("files") == nullptr);
+    assert(result.find_kw_arg_bool("verbose"));
+
+    // argv path
+    seen.clear();
+    const char *argv[] = {"test", "a", "b", "c"};
+    result = parser.parse(4, const_cast<char **>(argv));
+    assert(result.status == parser::ParseResult::ParserStatus_Success);
+    assert(seen.size() == 3 && seen[2] == "c");
+
+    // clearing the sink collects again
+    root.set_positional_sink("files", nullptr);
+    result = parser.parse("x y");
+    const std::vector<std::string> *files = result.get_pos_arg_list("files");
+    assert(files && files->size() == 2 && (*files)[1] == "y");
+
+    // the collected list is refilled in place by a reused result
+    const char *list_argv[] = {"test", "one", "two", "three"};
+    parser.parse_into(4, const_cast<char **>(list_argv), result);
+    const std::string *list_data = &(*result.get_pos_arg_list("files"))[0];
+    struct Reparse
+    {
+        parser::ArgumentParser *parser;
+        parser::ParseResult *result;
+        const char **argv;
+        void operator()() const { parser->parse_into(3, const_cast<char **>(argv), *result); }
+    };
+    Reparse reparse = {&parser, &result, list_argv};
+    assert(count_allocations(reparse) == 0);
+    files = result.get_pos_arg_list("files");
+    assert(files->size() == 2 && (*files)[1] == "two");
+    assert(&(*files)[0] == list_data);
+
+    bool threw = false;
+    try
+    {
+        root.set_positional_sink("missing", collectSinkValue);
+    }
+    catch (const std::invalid_argument &)
+    {
+        threw = true;
+    }
+    assert(threw);
+
+    std::cout << "Streamed positional lists test passed!\n";
+}
+
+void testResponseFiles()
+{
+    std::cout << "\nTesting response files...\n";
+    parser::ArgumentParser parser("test", "Test CLI parser");
+    parser::Command &root = parser.get_root_command();
+    root.add_keyword_arg("output", parser::make_aliases("-o", "--output"), "output", parser::ArgType_Single);
+    root.add_keyword_arg("verbose", parser::make_aliases("-v"), "verbose", parser::ArgType_Flag);
+    root.add_positional_arg("files", "files", parser::ArgType_Multiple);
+    parser.set_response_files(true);
+
+    {
+        std::ofstream outer("test_outer.rsp");
+        outer << "--output out.bin\n\"two words\" @test_inner.rsp\n";
+        std::ofstream inner("test_inner.rsp");
+        inner << "c.txt \"tab\\there\"";
+        std::ofstream cycle("test_cycle.rsp");
+        cycle << "x @test_cycle.rsp";
+    }
+
+    // files expand in place, nested files included
+    const char *argv[] = {"test", "-v", "@test_outer.rsp", "last"};
+    parser::ParseResult result = parser.parse(4, const_cast<char **>(argv));
+    assert(result.status == parser::ParseResult::ParserStatus_Success);
+    assert(result.find_kw_arg_bool("verbose"));
+    assert(result.find_kw_arg_string("output") == "out.bin");
+    std::vector<std::string> files = result.find_pos_arg_list("files");
+    assert(files.size() == 4);
+    assert(files[0] == "two words" && files[1] == "c.txt");
+    assert(files[2] == "tab\there" && files[3] == "last");
+
+    // cycles and missing files are errors
+    const char *cycle_argv[] = {"test", "@test_cycle.rsp"};
+    result = parser.parse(2, const_cast<char **>(cycle_argv));
+    assert(result.status == parser::ParseResult::ParserStatus_ParseError);
+    const char *missing_argv[] = {"test", "@test_missing.rsp"};
+    result = parser.parse(2, const_cast<char **>(missing_argv));
+    assert(result.status == parser::ParseResult::ParserStatus_ParseError);
+
+    // disabled: '@' arguments are plain values
+    parser.set_response_files(false);
+    result = parser.parse(2, const_cast<char **>(missing_argv));
+    assert(result.status == parser::ParseResult::ParserStatus_Success);
+    assert(result.find_pos_arg_list("files")[0] == "@test_missing.rsp");
+
+    std::remove("test_outer.rsp");
+    std::remove("test_inner.rsp");
+    std::remove("test_cycle.rsp");
+    std::cout << "Response files test passed!\n";
+}
+
+void testLongOptionPrefixes()
+{
+    std::cout << "\nTesting long option prefixes...\n";
+    parser::ArgumentParser parser("test", "Test CLI parser");
+    parser::Command &root = parser.get_root_command();
+    root.add_keyword_arg("verbose", parser::make_aliases("-v", "--verbose"), "verbose", parser::ArgType_Flag);
+    root.add_keyword_arg("version", parser::make_aliases("--version"), "version", parser::ArgType_Flag);
+    root.add_keyword_arg("output", parser::make_aliases("-o", "--output"), "output", parser::ArgType_Single);
+    root.add_keyword_arg("compression-level", parser::make_aliases("--compression-level"), "level", parser::ArgType_Single);
+
+    // off by default
+    parser::ParseResult result = parser.parse("--out x");
+    assert(result.status == parser::ParseResult::ParserStatus_ParseError);
+
+    root.set_allow_abbrev(true);
+    result = parser.parse("--out x --verb");
+    assert(result.status == parser::ParseResult::ParserStatus_Success);
+    assert(result.find_kw_arg_string("output") == "x");
+    assert(result.find_kw_arg_bool("verbose"));
+    assert(!result.find_kw_arg_bool("version"));
+
+    // exact names win; shared prefixes list the candidates
+    result = parser.parse("--version");
+    assert(result.find_kw_arg_bool("version"));
+    result = parser.parse("--ver");
+    assert(result.status == parser::ParseResult::ParserStatus_ParseError);
+    assert(result.error_message.find("--verbose") != std::string::npos);
+    assert(result.error_message.find("--version") != std::string::npos);
+    result = parser.parse("--nothing");
+    assert(result.status == parser::ParseResult::ParserStatus_ParseError);
+
+    // resolving an unambiguous prefix allocates nothing, even for names
+    // too long for std::string's inline buffer
+    const char *argv[] = {"test", "--verb", "--compression-leve", "9"};
+    struct Reparse
+    {
+        parser::ArgumentParser *parser;
+        parser::ParseResult *result;
+        const char **argv;
+        void operator()() const { parser->parse_into(4, const_cast<char **>(argv), *result); }
+    };
+    Reparse reparse = {&parser, &result, argv};
+    reparse();
+    assert(count_allocations(reparse) == 0);
+    assert(result.find_kw_arg_bool("verbose"));
+    assert(result.find_kw_arg_string("compression-level") == "9");
+
+    std::cout << "Long option prefixes test passed!\n";
+}
+
+void testChoices()
+{
+    std::cout << "\nTesting argument choices...\n";
+    parser::ArgumentParser parser("test", "Test CLI parser");
+    parser::Command &root = parser.get_root_command();
+    root.add_keyword_arg("format", parser::make_aliases("-f", "--format"), "output format",
+                         parser::ArgType_Single, false, parser::ArgValue("table"));
+    root.add_positional_arg("mode", "mode", parser::ArgType_Single, false);
+    std::vector<std::string> formats;
+    formats.push_back("json");
+    formats.push_back("yaml");
+    formats.push_back("table");
+    root.set_choices("format", formats);
+    std::vector<std::string> modes;
+    modes.push_back("fast");
+    modes.push_back("safe");
+    root.set_choices("mode", modes);
+
+    parser::ParseResult result = parser.parse("--format yaml safe");
+    assert(result.status == parser::ParseResult::ParserStatus_Success);
+    assert(result.get_kw_choice("format") == 1);
+    assert(result.find_kw_arg_string("format") == "yaml");
+    assert(result.get_pos_choice("mode") == 1);
+
+    // defaults map to their ordinal too; missing values have none
+    result = parser.parse("");
+    assert(result.get_kw_choice("format") == 2);
+    assert(result.get_pos_choice("mode") == parser::SlotTable::npos);
+
+    // values outside the set are rejected, in lazy mode too
+    result = parser.parse("-f xml");
+    assert(result.status == parser::ParseResult::ParserStatus_ParseError);
+    assert(result.error_message.find("json, yaml, table") != std::string::npos);
+    result.set_lazy_values(true);
+    parser.parse_into(std::string("slow"), result);
+    assert(result.status == parser::ParseResult::ParserStatus_ParseError);
+    const char *argv[] = {"test", "-f", "json", "fast"};
+    parser.parse_into(4, const_cast<char **>(argv), result);
+    assert(result.status == parser::ParseResult::ParserStatus_Success);
+    assert(result.get_kw_choice("format") == 0 && result.get_pos_choice("mode") == 0);
+
+    // help and completion list the choices
+    std::ostringstream help;
+    root.generate_help(help, "");
+    assert(help.str().find("{json|yaml|table}") != std::string::npos);
+    std::ostringstream completion;
+    parser::generate_bash_completion(completion, "test", root);
+    assert(completion.str().find("_parser_choices___format=( 'json' 'yaml' 'table' )") != std::string::npos);
+
+    // the perfect hash holds larger sets as well
+    parser::ChoiceTable table;
+    std::vector<std::string> keys;
+    for (int i = 0; i < 200; ++i) {
+        std::ostringstream key;
+        key << "choice" << i;
+        keys.push_back(key.str());
+    }
+    table.build(keys);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        assert(table.find(keys[i]) == i);
+    }
+    assert(table.find("choice200") == parser::ChoiceTable::npos);
+
+    std::cout << "Argument choices test passed!\n";
+}
+
+void testArgumentGroups()
+{
+    std::cout << "\nTesting argument groups...\n";
+    parser::ArgumentParser parser("test", "Test CLI parser");
+    parser::Command &root = parser.get_root_command();
+    root.add_keyword_arg("json", parser::make_aliases("--json"), "json output", parser::ArgType_Flag);
+    root.add_keyword_arg("yaml", parser::make_aliases("--yaml"), "yaml output", parser::ArgType_Flag);
+    root.add_keyword_arg("user", parser::make_aliases("-u", "--user"), "user", parser::ArgType_Single);
+    root.add_keyword_arg("password", parser::make_aliases("-p", "--password"), "password", parser::ArgType_Single);
+    root.add_keyword_arg("token", parser::make_aliases("-t", "--token"), "token", parser::ArgType_Single);
+    root.add_exclusive_group(parser::make_aliases("json", "yaml"));
+    root.add_at_least_one_group(parser::make_aliases("user", "token"));
+    root.add_requires("user", parser::make_aliases("password"));
+
+    parser::ParseResult result = parser.parse("--json -t abc");
+    assert(result.status == parser::ParseResult::ParserStatus_Success);
+    result = parser.parse("-u bob -p secret --yaml");
+    assert(result.status == parser::ParseResult::ParserStatus_Success);
+
+    // exclusive
+    result = parser.parse("--json --yaml -t abc");
+    assert(result.status == parser::ParseResult::ParserStatus_ParseError);
+    assert(result.error_message == "options --json, --yaml cannot be used together");
+    // at least one
+    result = parser.parse("--json");
+    assert(result.status == parser::ParseResult::ParserStatus_ParseError);
+    assert(result.error_message == "one of the options --user, --token is required");
+    // requires
+    result = parser.parse("-u bob");
+    assert(result.status == parser::ParseResult::ParserStatus_ParseError);
+    assert(result.error_message == "option --user requires --password");
+
+    // groups name defined options only
+    bool threw = false;
+    try
+    {
+        root.add_exclusive_group(parser::make_aliases("json", "xml"));
+    }
+    catch (const std::invalid_argument &)
+    {
+        threw = true;
+    }
+    assert(threw);
+
+    std::cout << "Argument groups test passed!\n";
+}
+
+void testResolveCommand()
+{
+    std::cout << "\nTesting dispatch-only command resolution...\n";
+    parser::ArgumentParser parser("git", "Test CLI parser");
+    parser::Command &root = parser.get_root_command();
+    root.add_keyword_arg("dir", parser::make_aliases("-C"), "directory", parser::ArgType_Single);
+    root.add_keyword_arg("verbose", parser::make_aliases("-v"), "verbose", parser::ArgType_Flag);
+    parser::command_ptr remote(new parser::Command("remote", "manage remotes"));
+    remote->add_keyword_arg("config", parser::make_aliases("-c"), "config", parser::ArgType_Multiple);
+    parser::command_ptr add(new parser::Command("add", "add a remote"));
+    add->add_keyword_arg("required", parser::make_aliases("-r"), "required", parser::ArgType_Single, true);
+    add->add_positional_arg("name", "name");
+    remote->add_command(add);
+    root.add_command(remote);
+    parser.freeze();
+
+    // "-C remote" is an option value, not the subcommand; required options
+    // of the leaf are not checked
+    const char *argv[] = {"git", "-C", "remote", "-v", "remote", "-c", "a", "b", "add", "origin"};
+    size_t arg_index = 0;
+    const parser::Command *command = parser.resolve_command(10, const_cast<char **>(argv), arg_index);
+    assert(command == &*remote);
+    assert(arg_index == 5);
+
+    const char *leaf_argv[] = {"git", "remote", "add", "origin", "-r", "x"};
+    command = parser.resolve_command(6, const_cast<char **>(leaf_argv), arg_index);
+    assert(command == &*add);
+    assert(arg_index == 3);
+
+    // token streams resolve the same way; no subcommand leaves the root
+    lexer::Src source = lexer::Src::from_string("-v remote add origin");
+    std::vector<lexer::Token> tokens = lexer::Lexer::tokenize(source);
+    size_t index = 0;
+    assert(root.resolve_command(tokens, index) == &*add);
+    assert(index == 3);
+    const char *root_argv[] = {"git", "-v"};
+    assert(parser.resolve_command(2, const_cast<char **>(root_argv), arg_index) == &root);
+    assert(arg_index == 1);
+
+    std::cout << "Dispatch-only command resolution test passed!\n";
+}
+
+void testPassThrough()
+{
+    std::cout << "\nTesting pass-through of unknown arguments...\n";
+    parser::ArgumentParser parser("wrap", "Test CLI parser");
+    parser::Command &root = parser.get_root_command();
+    root.add_keyword_arg("verbose", parser::make_aliases("-v"), "verbose", parser::ArgType_Flag);
+    root.add_keyword_arg("timeout", parser::make_aliases("-t", "--timeout"), "timeout", parser::ArgType_Single);
+    root.add_positional_arg("program", "program");
+
+    // strict by default
+    parser::ParseResult result = parser.parse("--color -v cc");
+    assert(result.status == parser::ParseResult::ParserStatus_ParseError);
+
+    result.set_pass_through(true);
+    const char *argv[] = {"wrap", "-v", "--color=auto", "cc", "-xz", "main", "--", "-o", "a b", "--timeout"};
+    parser.parse_into(10, const_cast<char **>(argv), result);
+    assert(result.status == parser::ParseResult::ParserStatus_Success);
+    assert(result.find_kw_arg_bool("verbose"));
+    assert(result.find_pos_arg_string("program") == "cc");
+    assert(!result.was_kw_slot_given(root.get_keyword_slot("timeout")));
+    assert(result.unknown_args.size() == 3);
+    // spans are the argv elements themselves
+    assert(result.unknown_args[0].start == argv[2]);
+    assert(result.unknown_args[1].start == argv[4] && result.unknown_args[1].length == 3);
+    assert(result.unknown_args[2].start == argv[5]);
+    assert(result.remainder_args.size() == 3);
+    assert(result.remainder_args[0].start == argv[7]);
+    assert(result.remainder_args[1].start == argv[8]);
+    assert(result.remainder_args[2].to_string() == "--timeout");
+
+    // string input: spans cover the exact text, quotes included
+    const std::string line = "--dry-run -t 5 make -- \"x y\" -k";
+    parser.parse_into(line, result);
+    assert(result.status == parser::ParseResult::ParserStatus_Success);
+    assert(result.find_kw_arg_int("timeout") == 5);
+    assert(result.unknown_args.size() == 1 && result.unknown_args[0].to_string() == "--dry-run");
+    assert(result.remainder_args.size() == 2);
+    assert(result.remainder_args[0].to_string() == "\"x y\"");
+    assert(result.remainder_args[1].start == line.data() + line.size() - 2);
+
+    std::cout << "Pass-through test passed!\n";
+}
+
+// Test that reparsing into one result does not allocate once warmed up
+void testSteadyStateAllocations()
+{
+    std::cout << "\nTesting steady-state parse allocations...\n";
+    parser::ArgumentParser parser("tool", "Test CLI parser");
+    parser::Command &root = parser.get_root_command();
+    root.add_keyword_arg("verbose", parser::make_aliases("-v"), "verbose", parser::ArgType_Flag);
+    root.add_keyword_arg("name", parser::make_aliases("-n"), "name", parser::ArgType_Single, false, parser::ArgValue("anon"));
+    root.add_keyword_arg("tags", parser::make_aliases("-t"), "tags", parser::ArgType_Multiple);
+    root.add_keyword_arg("ids", parser::make_aliases("-i"), "ids", parser::ArgType_MultipleInt);
+    root.add_keyword_arg("mode", parser::make_aliases("-m"), "mode", parser::ArgType_Single);
+    std::vector<std::string> modes;
+    modes.push_back("fast");
+    modes.push_back("safe");
+    root.set_choices("mode", modes);
+    root.add_positional_arg("files", "files", parser::ArgType_Multiple);
+    parser.freeze();
+
+    const char *argv[] = {"tool", "f1", "f2", "f3", "-v", "-n", "a-short-name", "-m", "safe",
+                          "-t", "x", "y", "z", "-i", "1", "2", "3"};
+    const int argc = sizeof(argv) / sizeof(argv[0]);
+    const char *other_argv[] = {"tool", "g1", "-t", "only", "-i", "4"};
+    parser::ParseResult result;
+    struct Parse
+    {
+        parser::ArgumentParser *parser;
+        parser::ParseResult *result;
+        int argc;
+        const char **argv;
+        void operator()() const { parser->parse_into(argc, const_cast<char **>(argv), *result); }
+    };
+    Parse full = {&parser, &result, argc, argv};
+    Parse partial = {&parser, &result, 6, other_argv};
+    full();
+    partial();
+    full();
+    assert(result.status == parser::ParseResult::ParserStatus_Success);
+    assert(result.get_kw_arg_list("tags")->size() == 3);
+    assert(result.find_kw_arg_int_span("ids").size() == 3);
+    assert(result.get_pos_arg_list("files")->size() == 3);
+
+    // flags, short strings, choices and all three list kinds reuse storage
+    assert(count_allocations(full) == 0);
+    assert(count_allocations(partial) == 0);
+    assert(result.get_kw_arg_list("tags")->size() == 1);
+    assert(count_allocations(full) == 0);
+    assert(*result.get_kw_arg_string("name") == "a-short-name");
+    assert(result.find_kw_arg_string("mode") == "safe");
+    assert(result.find_kw_arg_int_span("ids")[2] == 3);
+    assert((*result.get_pos_arg_list("files"))[2] == "f3");
+
+    std::cout << "Steady-state parse allocations test passed!\n";
+}
+
 int main()
 {
     try
@@ -348,6 +1724,32 @@ int main()
         testHelpFunctionality();
         testInvalidFlagCombinations();
         testMixedArguments();
+        testLexerCheckpointRewind();
+        testTokenBatch();
+        testOperatorTable();
+        testKindFilter();
+        testTokenCache();
+        testStreamLexer();
+        testIndexedFlagLookup();
+        testCombinedShortFlags();
+        testHashedSubcommandDispatch();
+        testSlotIndexedResult();
+        testTypedArgHandles();
+        testArgValueStorage();
+        testArgvParsing();
+        testFusedArgvParsing();
+        testParseIntoReuse();
+        testLazyDefaults();
+        testLazyValues();
+        testNumericLists();
+        testPositionalSink();
+        testResponseFiles();
+        testLongOptionPrefixes();
+        testChoices();
+        testArgumentGroups();
+        testResolveCommand();
+        testPassThrough();
+        testSteadyStateAllocations();
         
         std::cout << "\nAll tests passed!\n";
         return 0;